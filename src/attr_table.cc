@@ -0,0 +1,77 @@
+#include "attr_table.h"
+
+namespace vtutils {
+namespace screen {
+
+const size_t AttrTable::MAX_SIZE;
+
+// Packs a color into 32 bits. RGB values only take part for RGB colors, to
+// agree with operator==.
+static uint64_t pack(const Color &color) {
+  // the code is taken as a byte: COLOR_CODE_RGB is negative, and would
+  // set every bit if sign extended
+  uint64_t key = uint8_t(color.color_code);
+  if (color.color_code == COLOR_CODE_RGB) {
+    key |= uint64_t(color.r) << 8 | uint64_t(color.g) << 16 | uint64_t(color.b) << 24;
+  }
+  return key;
+}
+
+size_t AttrHash::operator()(const Attr &attr) const {
+  uint64_t key = pack(attr.fg) ^ (pack(attr.bg) << 32);
+  key ^= uint64_t(attr.bold)
+      | uint64_t(attr.underline) << 1
+      | uint64_t(attr.inverse) << 2
+      | uint64_t(attr.protect) << 3
+      | uint64_t(attr.blink) << 4;
+  // fibonacci hashing; spreads the few bits that differ over the word
+  return (key * 0x9e3779b97f4a7c15ull) >> 16;
+}
+
+AttrTable::AttrTable()
+    : _attrs(1, Attr{}),
+      _marks(1, 0),
+      _epoch(1) {
+  _ids.emplace(Attr{}, DEFAULT_ATTR_ID);
+}
+
+attr_id AttrTable::intern(const Attr &attr) {
+  auto it = _ids.find(attr);
+  if (it != _ids.end()) {
+    return it->second;
+  }
+
+  attr_id id;
+  if (!_free.empty()) {
+    id = _free.back();
+    _free.pop_back();
+    _attrs[id] = attr;
+  } else if (_attrs.size() < MAX_SIZE) {
+    id = _attrs.size();
+    _attrs.push_back(attr);
+    _marks.push_back(0);
+  } else {
+    return DEFAULT_ATTR_ID;
+  }
+  // a new entry counts as marked, so it survives a sweep that is already
+  // in progress
+  _marks[id] = _epoch;
+  _ids.emplace(attr, id);
+  return id;
+}
+
+size_t AttrTable::sweep() {
+  for (auto it = _ids.begin(); it != _ids.end();) {
+    if (it->second != DEFAULT_ATTR_ID && _marks[it->second] != _epoch) {
+      _free.push_back(it->second);
+      it = _ids.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  ++_epoch;
+  return _ids.size();
+}
+
+} // namespace screen
+} // namespace vtutils
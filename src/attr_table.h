@@ -0,0 +1,64 @@
+#ifndef VTUTILS_ATTR_TABLE_H_
+#define VTUTILS_ATTR_TABLE_H_
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "screen.h"
+
+namespace vtutils {
+namespace screen {
+
+// Attribute ID stored in each cell of a GridScreen
+typedef uint16_t attr_id;
+
+// ID of the default attributes (Attr{}), which is always present
+static const attr_id DEFAULT_ATTR_ID = 0;
+
+struct AttrHash {
+  size_t operator()(const Attr &attr) const;
+};
+
+// Interning table that maps each distinct Attr to a 16-bit ID.
+//
+// Entries are never removed by intern(). Unused entries are reclaimed with
+// an epoch based mark & sweep: the owner calls mark() for every ID it still
+// holds (in cells, saved state, ...), then sweep() frees everything that was
+// not marked since the previous sweep. Freed IDs are reused by later
+// intern() calls.
+class AttrTable {
+public:
+  // the largest number of IDs the table hands out
+  static const size_t MAX_SIZE = UINT16_MAX + 1;
+
+  AttrTable();
+
+  // The ID of attr, adding it to the table if needed. Returns
+  // DEFAULT_ATTR_ID if the table is full.
+  attr_id intern(const Attr &attr);
+
+  const Attr& operator[](attr_id id) const { return _attrs[id]; }
+
+  // number of IDs in use
+  size_t size() const { return _ids.size(); }
+  bool full() const { return size() >= MAX_SIZE; }
+
+  void mark(attr_id id) { _marks[id] = _epoch; }
+  // Frees every ID not marked since the last sweep and starts a new epoch.
+  // Returns the number of IDs left in use.
+  size_t sweep();
+
+private:
+  std::unordered_map<Attr, attr_id, AttrHash> _ids;
+  // indexed by ID
+  std::vector<Attr> _attrs;
+  std::vector<uint32_t> _marks;
+  std::vector<attr_id> _free;
+  uint32_t _epoch;
+};
+
+} // namespace screen
+} // namespace vtutils
+
+#endif /* VTUTILS_ATTR_TABLE_H_ */
@@ -0,0 +1,187 @@
+#include "box_screen.h"
+
+#include <algorithm>
+
+namespace vtutils {
+namespace screen {
+
+// front buffer contents that never match a cell, to force a redraw
+static const char32_t STALE_CELL = 0xffffffff;
+
+// longest run sent to the parent in one print_run call
+static const unsigned int RUN_MAX = 256;
+
+BoxScreen::BoxScreen(
+    Screen &parent,
+    unsigned int cols,
+    unsigned int rows,
+    unsigned int left,
+    unsigned int top,
+    unsigned int view_cols,
+    unsigned int view_rows)
+    : GridScreen(cols, rows),
+      _parent(parent),
+      _left(left),
+      _top(top),
+      _window_cols(view_cols),
+      _window_rows(view_rows),
+      _view_cols(std::min(view_cols, this->cols())),
+      _view_rows(std::min(view_rows, this->rows())),
+      _front_chars(_view_cols * _view_rows, STALE_CELL),
+      _front_attrs(_view_cols * _view_rows) {
+}
+
+void BoxScreen::resize(unsigned int cols, unsigned int rows) {
+  GridScreen::resize(cols, rows);
+  _view_cols = std::min(_window_cols, this->cols());
+  _view_rows = std::min(_window_rows, this->rows());
+  _view_x = std::min(_view_x, this->cols() - _view_cols);
+  _view_y = std::min(_view_y, this->rows() - _view_rows);
+  _front_chars.assign(_view_cols * _view_rows, STALE_CELL);
+  _front_attrs.assign(_view_cols * _view_rows, Attr{});
+  _stale = true;
+}
+
+void BoxScreen::set_view(unsigned int x, unsigned int y) {
+  x = std::min(x, cols() - _view_cols);
+  y = std::min(y, rows() - _view_rows);
+  if (x != _view_x || y != _view_y) {
+    _view_x = x;
+    _view_y = y;
+    invalidate();
+  }
+}
+
+void BoxScreen::invalidate() {
+  std::fill(_front_chars.begin(), _front_chars.end(), STALE_CELL);
+  _stale = true;
+}
+
+void BoxScreen::present() {
+  follow_cursor();
+
+  // Only the damaged cells of the box can differ from what the parent
+  // shows, unless the window moved. Shifted rows are compared in full: the
+  // parent's rows do not move with them.
+  Damage damage = collect_damage();
+  std::vector<unsigned int> begin(_view_rows, _stale ? 0 : _view_cols);
+  std::vector<unsigned int> end(_view_rows, _stale ? _view_cols : 0);
+  _stale = false;
+  auto add = [&](unsigned int row, unsigned int b, unsigned int e) {
+    if (row < _view_y || row >= _view_y + _view_rows) {
+      return;
+    }
+    b = std::max(b, _view_x);
+    e = std::min(e, _view_x + _view_cols);
+    if (b < e) {
+      unsigned int y = row - _view_y;
+      begin[y] = std::min(begin[y], b - _view_x);
+      end[y] = std::max(end[y], e - _view_x);
+    }
+  };
+  for (const ScrollDamage &scroll : damage.scrolls) {
+    for (unsigned int row = scroll.top; row <= scroll.bottom; ++row) {
+      add(row, 0, cols());
+    }
+  }
+  for (const RowDamage &row : damage.rows) {
+    add(row.row, row.begin, row.end);
+  }
+
+  for (unsigned int y = 0; y < _view_rows; ++y) {
+    if (begin[y] < end[y]) {
+      present_row(y, begin[y], end[y]);
+    }
+  }
+
+  unsigned int cx = std::min(cursor_x(), cols() - 1);
+  _parent.move_to(_left + cx - _view_x, _top + cursor_y() - _view_y);
+  // a parent that batches its drawing shows the frame now
+  _parent.flush();
+}
+
+// Send the changed cells between columns begin and end of window row y
+void BoxScreen::present_row(unsigned int y, unsigned int begin, unsigned int end) {
+  const char32_t *chars = row_chars(_view_y + y) + _view_x;
+  const attr_id *attrs = row_attrs(_view_y + y) + _view_x;
+  char32_t *front_chars = &_front_chars[y * _view_cols];
+  Attr *front_attrs = &_front_attrs[y * _view_cols];
+
+  // a wide character the right edge of the window cuts in half
+  auto cut = [&](unsigned int x) {
+    return x + 1 == _view_cols && _view_x + _view_cols < cols()
+        && chars[x + 1] == WIDE_TAIL_CELL;
+  };
+
+  char32_t run[RUN_MAX];
+  unsigned int x = begin;
+  while (x < end) {
+    // cluster IDs can be reused once collected, so clusters are always
+    // sent again
+    if (chars[x] == front_chars[x] && attr(attrs[x]) == front_attrs[x]
+        && !(chars[x] & CLUSTER_CELL)) {
+      ++x;
+      continue;
+    }
+
+    const Attr &run_attr = attr(attrs[x]);
+    unsigned int start = x;
+    if ((chars[x] & CLUSTER_CELL) && !cut(x)) {
+      // a cluster is sent on its own, along with its right half if wide
+      std::u32string_view cluster = cell_text(chars[x]);
+      _parent.move_to(_left + x, _top + y);
+      _parent.print_cluster(cluster.data(), cluster.size(), run_attr);
+      do {
+        front_chars[x] = chars[x];
+        front_attrs[x] = run_attr;
+        ++x;
+      } while (x < _view_cols && chars[x] == WIDE_TAIL_CELL);
+      continue;
+    }
+
+    // a run of changed cells with the same attributes. A wide character
+    // is sent whole, and shown as a space where the window cuts it in half.
+    unsigned int num = 0;
+    while (x < end && (num < RUN_MAX || chars[x] == WIDE_TAIL_CELL)
+        && attrs[x] == attrs[start]
+        && (x == start || !(chars[x] & CLUSTER_CELL))
+        && (chars[x] != front_chars[x] || run_attr != front_attrs[x])) {
+      char32_t sym = chars[x];
+      if (sym == WIDE_TAIL_CELL) {
+        sym = x > start ? EMPTY_CELL : ' ';
+      } else if (sym == EMPTY_CELL || cut(x)) {
+        sym = ' ';
+      }
+      if (sym != EMPTY_CELL) {
+        run[num++] = sym;
+      }
+      front_chars[x] = chars[x];
+      front_attrs[x] = run_attr;
+      ++x;
+    }
+    _parent.move_to(_left + start, _top + y);
+    _parent.print_run(run, num, run_attr);
+  }
+}
+
+// Scroll the window just enough to show the cursor
+void BoxScreen::follow_cursor() {
+  unsigned int cx = std::min(cursor_x(), cols() - 1);
+  unsigned int cy = cursor_y();
+  unsigned int x = _view_x;
+  unsigned int y = _view_y;
+  if (cx < x) {
+    x = cx;
+  } else if (cx >= x + _view_cols) {
+    x = cx + 1 - _view_cols;
+  }
+  if (cy < y) {
+    y = cy;
+  } else if (cy >= y + _view_rows) {
+    y = cy + 1 - _view_rows;
+  }
+  set_view(x, y);
+}
+
+} // namespace screen
+} // namespace vtutils
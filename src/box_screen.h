@@ -0,0 +1,82 @@
+#ifndef VTUTILS_BOX_SCREEN_H_
+#define VTUTILS_BOX_SCREEN_H_
+
+#include <vector>
+
+#include "grid_screen.h"
+
+namespace vtutils {
+namespace screen {
+
+// A virtual terminal of any size, shown in a rectangular window of a parent
+// Screen.
+//
+// The box keeps its own grid (it is a GridScreen), and nothing reaches the
+// parent until present() is called. present() then sends only the cells
+// that changed since the previous call, as runs of print_run at the
+// translated position, so several boxes sharing a terminal cost no more than
+// what they actually change. The box's damage (see collect_damage) limits
+// which cells are compared; a copy of what the parent was sent drops the
+// cells rewritten with the same contents.
+//
+// If the box is larger than its window, the window follows the cursor; it
+// can also be placed with set_view. If the box is resized to smaller than
+// its window, the window shrinks with it, and grows back to the size it
+// was given as the box grows.
+class BoxScreen : public GridScreen {
+public:
+  // A cols x rows box, shown in a view_cols x view_rows window whose top
+  // left corner is at (left, top) of parent. The window is shrunk to the
+  // size of the box if needed.
+  BoxScreen(
+      Screen &parent,
+      unsigned int cols,
+      unsigned int rows,
+      unsigned int left,
+      unsigned int top,
+      unsigned int view_cols,
+      unsigned int view_rows);
+  virtual ~BoxScreen() = default;
+
+  // The parent must clear what a shrinking window no longer covers
+  void resize(unsigned int cols, unsigned int rows) override;
+
+  // Scroll the window so that (x, y) of the box is in its top left corner
+  void set_view(unsigned int x, unsigned int y);
+  unsigned int view_x() const { return _view_x; }
+  unsigned int view_y() const { return _view_y; }
+
+  // Forget what the parent shows, so the next present() redraws the whole
+  // window. Use after the parent was cleared or drawn over.
+  void invalidate();
+
+  // Send the changes to the parent, place the parent's cursor on the box
+  // cursor, and flush the parent
+  void present();
+
+private:
+  Screen &_parent;
+  const unsigned int _left;
+  const unsigned int _top;
+  // the window size asked for, and the size it has, no larger than the box
+  const unsigned int _window_cols;
+  const unsigned int _window_rows;
+  unsigned int _view_cols;
+  unsigned int _view_rows;
+  unsigned int _view_x = 0;
+  unsigned int _view_y = 0;
+
+  // what the parent currently shows, by window position
+  std::vector<char32_t> _front_chars;
+  std::vector<Attr> _front_attrs;
+  // the front buffer must be compared in full
+  bool _stale = true;
+
+  void present_row(unsigned int y, unsigned int begin, unsigned int end);
+  void follow_cursor();
+};
+
+} // namespace screen
+} // namespace vtutils
+
+#endif /* VTUTILS_BOX_SCREEN_H_ */
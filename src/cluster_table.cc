@@ -0,0 +1,116 @@
+#include "cluster_table.h"
+
+#include <algorithm>
+
+namespace vtutils {
+namespace screen {
+
+const size_t ClusterTable::MAX_SIZE;
+const size_t ClusterTable::MAX_LENGTH;
+
+static const size_t MIN_SLOTS = 64;
+
+ClusterTable::ClusterTable()
+    : _size(0),
+      _slots(MIN_SLOTS, 0),
+      _epoch(1) {
+}
+
+// FNV-1a over the code points
+uint32_t ClusterTable::hash(const char32_t *syms, size_t num) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < num; ++i) {
+    h = (h ^ syms[i]) * 16777619u;
+  }
+  return h;
+}
+
+bool ClusterTable::intern(const char32_t *syms, size_t num, cluster_id &id) {
+  num = std::min(num, MAX_LENGTH);
+  uint32_t h = hash(syms, num);
+  size_t mask = _slots.size() - 1;
+  for (size_t i = h & mask; _slots[i] != 0; i = (i + 1) & mask) {
+    const Entry &entry = _entries[_slots[i] - 1];
+    if (entry.hash == h
+        && entry.length == num
+        && std::equal(syms, syms + num, &_arena[entry.offset])) {
+      id = _slots[i] - 1;
+      return true;
+    }
+  }
+
+  if (!_free.empty()) {
+    id = _free.back();
+    _free.pop_back();
+  } else if (_entries.size() < MAX_SIZE) {
+    id = _entries.size();
+    _entries.emplace_back();
+    _marks.push_back(0);
+  } else {
+    return false;
+  }
+  _entries[id] = Entry{uint32_t(_arena.size()), uint32_t(num), h};
+  _arena.insert(_arena.end(), syms, syms + num);
+  // a new entry counts as marked, so it survives a sweep that is already
+  // in progress
+  _marks[id] = _epoch;
+  ++_size;
+
+  if (2 * _size > _slots.size()) {
+    rehash(2 * _slots.size());
+  } else {
+    insert_slot(id);
+  }
+  return true;
+}
+
+size_t ClusterTable::sweep() {
+  // copy the live clusters to a fresh arena, keeping their IDs
+  std::vector<char32_t> arena;
+  arena.reserve(_arena.size());
+  for (cluster_id id = 0; id < _entries.size(); ++id) {
+    Entry &entry = _entries[id];
+    if (entry.length == 0) {
+      continue;
+    }
+    if (_marks[id] != _epoch) {
+      entry.length = 0;
+      _free.push_back(id);
+      --_size;
+      continue;
+    }
+    auto first = _arena.begin() + entry.offset;
+    entry.offset = arena.size();
+    arena.insert(arena.end(), first, first + entry.length);
+  }
+  _arena.swap(arena);
+
+  size_t num_slots = MIN_SLOTS;
+  while (num_slots < 2 * _size) {
+    num_slots *= 2;
+  }
+  rehash(num_slots);
+  ++_epoch;
+  return _size;
+}
+
+void ClusterTable::insert_slot(cluster_id id) {
+  size_t mask = _slots.size() - 1;
+  size_t i = _entries[id].hash & mask;
+  while (_slots[i] != 0) {
+    i = (i + 1) & mask;
+  }
+  _slots[i] = id + 1;
+}
+
+void ClusterTable::rehash(size_t num_slots) {
+  _slots.assign(num_slots, 0);
+  for (cluster_id id = 0; id < _entries.size(); ++id) {
+    if (_entries[id].length != 0) {
+      insert_slot(id);
+    }
+  }
+}
+
+} // namespace screen
+} // namespace vtutils
@@ -0,0 +1,78 @@
+#ifndef VTUTILS_CLUSTER_TABLE_H_
+#define VTUTILS_CLUSTER_TABLE_H_
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace vtutils {
+namespace screen {
+
+// Cluster ID stored in a cell of a GridScreen, for a grapheme cluster of
+// more than one code point
+typedef uint32_t cluster_id;
+
+// Interning table that maps each distinct grapheme cluster (a base
+// character and the code points combining with it) to an ID.
+//
+// The code points of all the clusters are held back to back in a single
+// arena, found through an open addressing hash table of IDs, so a cluster
+// costs no allocation of its own. Unused entries are reclaimed with the
+// same epoch based mark & sweep as AttrTable; sweep() also compacts the
+// arena. Freed IDs are reused by later intern() calls.
+class ClusterTable {
+public:
+  // the largest number of IDs the table hands out
+  static const size_t MAX_SIZE = 1 << 24;
+  // the longest cluster kept; code points past it are dropped
+  static const size_t MAX_LENGTH = 32;
+
+  ClusterTable();
+
+  // Sets id to the ID of the cluster of num (at least one) code points at
+  // syms, adding it to the table if needed. Returns false if the table is
+  // full.
+  bool intern(const char32_t *syms, size_t num, cluster_id &id);
+
+  std::u32string_view operator[](cluster_id id) const {
+    const Entry &entry = _entries[id];
+    return std::u32string_view(&_arena[entry.offset], entry.length);
+  }
+
+  // number of IDs in use
+  size_t size() const { return _size; }
+  bool full() const { return size() >= MAX_SIZE; }
+
+  void mark(cluster_id id) { _marks[id] = _epoch; }
+  // Frees every ID not marked since the last sweep and starts a new epoch.
+  // Returns the number of IDs left in use.
+  size_t sweep();
+
+private:
+  struct Entry {
+    uint32_t offset;
+    uint32_t length;
+    uint32_t hash;
+  };
+
+  // code points of the clusters
+  std::vector<char32_t> _arena;
+  // indexed by ID; free entries have length 0
+  std::vector<Entry> _entries;
+  std::vector<uint32_t> _marks;
+  std::vector<cluster_id> _free;
+  size_t _size;
+  // IDs + 1 by hash, 0 for an empty slot; a power of two in size, at most
+  // half full
+  std::vector<uint32_t> _slots;
+  uint32_t _epoch;
+
+  static uint32_t hash(const char32_t *syms, size_t num);
+  void insert_slot(cluster_id id);
+  void rehash(size_t num_slots);
+};
+
+} // namespace screen
+} // namespace vtutils
+
+#endif /* VTUTILS_CLUSTER_TABLE_H_ */
@@ -1,17 +1,46 @@
 #include "curses_screen.h"
 
+#include <algorithm>
 #include <iostream>
+
 #include "unicode.h"
 
 namespace vtutils {
 namespace screen {
 
+// distance between the default tab stops
+static const unsigned int TAB_WIDTH = 8;
+
+CursesScreen::CursesScreen(WINDOW *win, std::ostream &out)
+    : DebugScreen(out), _win(win) {
+  int rows, cols;
+  getmaxyx(_win, rows, cols);
+  _cols = cols > 0 ? cols : 1;
+  _rows = rows > 0 ? rows : 1;
+  _margin_top = 0;
+  _margin_bottom = _rows - 1;
+  _tabs.resize(_cols);
+  // the window only scrolls when told to, see scroll_region
+  scrollok(_win, FALSE);
+  wsetscrreg(_win, _margin_top, _margin_bottom);
+}
+
 void CursesScreen::reset() {
   _super::reset();
   _flags = 0;
+  _pending_wrap = false;
+  _margin_top = 0;
+  _margin_bottom = _rows - 1;
+  wsetscrreg(_win, _margin_top, _margin_bottom);
+  for (unsigned int i = 0; i < _cols; ++i) {
+    _tabs[i] = i % TAB_WIDTH == 0;
+  }
   curs_set(1);
 }
 void CursesScreen::hard_reset() {
+  reset();
+  werase(_win);
+  move(0, 0);
   _super::hard_reset();
 }
 
@@ -52,125 +81,388 @@ void CursesScreen::reset_flags(unsigned int flags) {
 }
 
 void CursesScreen::print(char32_t sym, Attr *attr) {
-  char u8[4];
-  for (int i = 0; i < unicode::Utf8To32Converter::reverse(u8, sym); i++) {
-    if (wechochar(_win, u8[i]) != OK) {
-      _out << "Error writing symbol to screen";
+  put(sym, *attr);
+  update_if_due();
+  _super::print(sym, attr);
+}
+
+void CursesScreen::print_run(const char32_t *syms, size_t num, const Attr &attr) {
+  for (size_t i = 0; i < num; ++i) {
+    put(syms[i], attr);
+  }
+  update_if_due();
+  _super::print_run(syms, num, attr);
+}
+
+void CursesScreen::newline() {
+  move_down(1, true);
+  move_line_home();
+  _super::newline();
+}
+
+void CursesScreen::insert_lines(unsigned int num) {
+  int y, x;
+  getyx(_win, y, x);
+  if (unsigned(y) >= _margin_top && unsigned(y) <= _margin_bottom) {
+    num = std::min(num, _margin_bottom - y + 1);
+    if (_margin_bottom == _rows - 1) {
+      winsdelln(_win, num);
+    } else if (unsigned(y) == _margin_bottom) {
+      // curses can't make a one line scroll region
+      wmove(_win, y, 0);
+      wclrtoeol(_win);
+    } else {
+      // winsdelln ignores the scroll region, so scroll a region that starts
+      // at the cursor instead
+      wsetscrreg(_win, y, _margin_bottom);
+      scroll_region(-int(num));
+      wsetscrreg(_win, _margin_top, _margin_bottom);
     }
+    move(0, y);
   }
-  _super::print(sym, attr);
+  _super::insert_lines(num);
+}
+void CursesScreen::delete_lines(unsigned int num) {
+  int y, x;
+  getyx(_win, y, x);
+  if (unsigned(y) >= _margin_top && unsigned(y) <= _margin_bottom) {
+    num = std::min(num, _margin_bottom - y + 1);
+    if (_margin_bottom == _rows - 1) {
+      winsdelln(_win, -int(num));
+    } else if (unsigned(y) == _margin_bottom) {
+      // curses can't make a one line scroll region
+      wmove(_win, y, 0);
+      wclrtoeol(_win);
+    } else {
+      wsetscrreg(_win, y, _margin_bottom);
+      scroll_region(num);
+      wsetscrreg(_win, _margin_top, _margin_bottom);
+    }
+    move(0, y);
+  }
+  _super::delete_lines(num);
+}
+void CursesScreen::insert_chars(unsigned int num) {
+  int y, x;
+  getyx(_win, y, x);
+  cchar_t blank;
+  setcchar(&blank, L" ", A_NORMAL, 0, nullptr);
+  for (unsigned int i = std::min(num, _cols - x); i > 0; --i) {
+    wins_wch(_win, &blank);
+  }
+  move(x, y);
+  _super::insert_chars(num);
+}
+void CursesScreen::delete_chars(unsigned int num) {
+  int y, x;
+  getyx(_win, y, x);
+  for (unsigned int i = std::min(num, _cols - x); i > 0; --i) {
+    wdelch(_win);
+  }
+  move(x, y);
+  _super::delete_chars(num);
+}
+void CursesScreen::alert() {
+  beep();
+  _super::alert();
+}
+
+Attr CursesScreen::default_attr() {
+  _super::default_attr();
+  return _def_attr;
+}
+void CursesScreen::set_def_attr(Attr attr) {
+  _def_attr = attr;
+  _super::set_def_attr(attr);
+}
+
+void CursesScreen::move_left(unsigned int num) {
+  int y, x;
+  getyx(_win, y, x);
+  move(x - std::min(num, unsigned(x)), y);
+  _super::move_left(num);
+}
+void CursesScreen::move_right(unsigned int num) {
+  int y, x;
+  getyx(_win, y, x);
+  move(std::min(x + std::min(num, _cols), _cols - 1), y);
+  _super::move_right(num);
+}
+void CursesScreen::move_up(unsigned int num, bool scroll) {
+  int y, x;
+  getyx(_win, y, x);
+  unsigned int top = unsigned(y) >= _margin_top ? _margin_top : 0;
+  unsigned int diff = y - top;
+  if (num > diff) {
+    if (scroll) {
+      scroll_region(-int(num - diff));
+    }
+    move(x, top);
+  } else {
+    move(x, y - num);
+  }
+  _super::move_up(num, scroll);
+}
+void CursesScreen::move_down(unsigned int num, bool scroll) {
+  int y, x;
+  getyx(_win, y, x);
+  unsigned int bottom = unsigned(y) <= _margin_bottom ? _margin_bottom : _rows - 1;
+  unsigned int diff = bottom - y;
+  if (num > diff) {
+    if (scroll) {
+      scroll_region(num - diff);
+    }
+    move(x, bottom);
+  } else {
+    move(x, y + num);
+  }
+  _super::move_down(num, scroll);
+}
+void CursesScreen::move_to(unsigned int x, unsigned int y) {
+  unsigned int last = _rows - 1;
+  if (_flags & SCREEN_REL_ORIGIN) {
+    y += _margin_top;
+    last = _margin_bottom;
+  }
+  move(std::min(x, _cols - 1), std::min(y, last));
+  _super::move_to(x, y);
+}
+void CursesScreen::move_line_home() {
+  move(0, getcury(_win));
+  _super::move_line_home();
+}
+
+void CursesScreen::scroll_up(unsigned int num) {
+  scroll_region(num);
+  _super::scroll_up(num);
+}
+void CursesScreen::scroll_down(unsigned int num) {
+  scroll_region(-int(num));
+  _super::scroll_down(num);
+}
+
+void CursesScreen::set_tabstop() {
+  _tabs[getcurx(_win)] = true;
+  _super::set_tabstop();
+}
+void CursesScreen::reset_tabstop() {
+  _tabs[getcurx(_win)] = false;
+  _super::reset_tabstop();
+}
+void CursesScreen::reset_all_tabstops() {
+  std::fill(_tabs.begin(), _tabs.end(), false);
+  _super::reset_all_tabstops();
+}
+void CursesScreen::tab_right(unsigned int num) {
+  int y, x;
+  getyx(_win, y, x);
+  for (unsigned int i = 0; i < num && unsigned(x) + 1 < _cols; ++i) {
+    ++x;
+    while (unsigned(x) < _cols - 1 && !_tabs[x]) {
+      ++x;
+    }
+  }
+  move(x, y);
+  _super::tab_right(num);
+}
+void CursesScreen::tab_left(unsigned int num) {
+  int y, x;
+  getyx(_win, y, x);
+  for (unsigned int i = 0; i < num && x > 0; ++i) {
+    --x;
+    while (x > 0 && !_tabs[x]) {
+      --x;
+    }
+  }
+  move(x, y);
+  _super::tab_left(num);
+}
+
+unsigned int CursesScreen::get_cursor_x() {
+  _super::get_cursor_x();
+  return getcurx(_win) + (_pending_wrap ? 1 : 0);
+}
+unsigned int CursesScreen::get_cursor_y() {
+  _super::get_cursor_y();
+  return getcury(_win);
+}
+
+// curses has no protected cells, so protect is ignored by the erases
+void CursesScreen::erase_screen(bool protect) {
+  int y, x;
+  getyx(_win, y, x);
+  werase(_win);
+  wmove(_win, y, x);
+  _super::erase_screen(protect);
+}
+void CursesScreen::erase_cursor_to_screen(bool protect) {
+  wclrtobot(_win);
+  _super::erase_cursor_to_screen(protect);
+}
+void CursesScreen::erase_screen_to_cursor(bool protect) {
+  int y, x;
+  getyx(_win, y, x);
+  for (int row = 0; row < y; ++row) {
+    wmove(_win, row, 0);
+    wclrtoeol(_win);
+  }
+  wmove(_win, y, 0);
+  whline(_win, ' ', x + 1);
+  wmove(_win, y, x);
+  _super::erase_screen_to_cursor(protect);
+}
+void CursesScreen::erase_cursor_to_end(bool protect) {
+  wclrtoeol(_win);
+  _super::erase_cursor_to_end(protect);
+}
+void CursesScreen::erase_home_to_cursor(bool protect) {
+  int y, x;
+  getyx(_win, y, x);
+  wmove(_win, y, 0);
+  whline(_win, ' ', x + 1);
+  wmove(_win, y, x);
+  _super::erase_home_to_cursor(protect);
+}
+void CursesScreen::erase_current_line(bool protect) {
+  int y, x;
+  getyx(_win, y, x);
+  wmove(_win, y, 0);
+  wclrtoeol(_win);
+  wmove(_win, y, x);
+  _super::erase_current_line(protect);
+}
+void CursesScreen::erase_chars(unsigned int num) {
+  whline(_win, ' ', std::min(num, _cols - getcurx(_win)));
+  _super::erase_chars(num);
+}
+
+void CursesScreen::set_margins(unsigned int top, unsigned int bottom) {
+  // 1-based, 0 selecting the default, as for GridScreen
+  if (top == 0) {
+    top = 1;
+  }
+  if (bottom == 0) {
+    bottom = _rows;
+  }
+  if (bottom <= top || bottom > _rows) {
+    _margin_top = 0;
+    _margin_bottom = _rows - 1;
+  } else {
+    _margin_top = top - 1;
+    _margin_bottom = bottom - 1;
+  }
+  wsetscrreg(_win, _margin_top, _margin_bottom);
+  move_to(0, 0);
+  _super::set_margins(top, bottom);
+}
+
+void CursesScreen::resize(unsigned int cols, unsigned int rows) {
+  cols = cols ? cols : 1;
+  rows = rows ? rows : 1;
+  int y, x;
+  getyx(_win, y, x);
+  // the window keeps the cells that still fit; lines are not reflowed
+  wresize(_win, rows, cols);
+  _tabs.resize(cols);
+  for (unsigned int i = _cols; i < cols; ++i) {
+    _tabs[i] = i % TAB_WIDTH == 0;
+  }
+  _cols = cols;
+  _rows = rows;
+  _margin_top = 0;
+  _margin_bottom = _rows - 1;
+  wsetscrreg(_win, _margin_top, _margin_bottom);
+  move(std::min(unsigned(x), _cols - 1), std::min(unsigned(y), _rows - 1));
+  _super::resize(cols, rows);
+}
+
+void CursesScreen::flush() {
+  update();
+  _super::flush();
 }
 
-// void CursesScreen::newline() {
-//   std::cout << "CursesScreen#newline: " << std::endl;
-// }
-// void CursesScreen::insert_lines(unsigned int num) {
-//   std::cout << "CursesScreen#insert_lines: " << num << std::endl;
-// }
-// void CursesScreen::delete_lines(unsigned int num) {
-//   std::cout << "CursesScreen#delete_lines: " << num << std::endl;
-// }
-// void CursesScreen::insert_chars(unsigned int num) {
-//   std::cout << "CursesScreen#insert_chars: " << num << std::endl;
-// }
-// void CursesScreen::delete_chars(unsigned int num) {
-//   std::cout << "CursesScreen#delete_chars: " << num << std::endl;
-// }
-// system bell
-// void CursesScreen::alert() {
-//   std::cout << "CursesScreen#alert: " << std::endl;
-// }
-//
-// Attr CursesScreen::default_attr() {
-//   std::cout << "CursesScreen#default_attr: " << std::endl;
-//   return Attr{};
-// }
-//
-// void CursesScreen::set_def_attr(Attr attr) {
-//   std::cout << "CursesScreen#set_def_attr: " << attr << std::endl;
-// }
-//
-// void CursesScreen::move_left(unsigned int num) {
-//   std::cout << "CursesScreen#move_left: " << num << std::endl;
-// }
-// void CursesScreen::move_right(unsigned int num) {
-//   std::cout << "CursesScreen#move_right: " << num << std::endl;
-// }
-// void CursesScreen::move_to(unsigned int x, unsigned int y) {
-//   std::cout << "CursesScreen#move_to: " << x << ", " << y << std::endl;
-// }
-// void CursesScreen::move_up(unsigned int num, bool scroll) {
-//   std::cout << "CursesScreen#move_up: " << num << ", " << scroll << std::endl;
-// }
-// void CursesScreen::move_down(unsigned int num, bool scroll) {
-//   std::cout << "CursesScreen#move_down: " << num << ", " << scroll << std::endl;
-// }
-// void CursesScreen::move_line_home() {
-//   std::cout << "CursesScreen#move_line_home: " << std::endl;
-// }
-//
-// void CursesScreen::scroll_up(unsigned int num) {
-//   std::cout << "CursesScreen#scroll_up: " << num << std::endl;
-// }
-// void CursesScreen::scroll_down(unsigned int num) {
-//   std::cout << "CursesScreen#scroll_down: " << num << std::endl;
-// }
-//
-// void CursesScreen::set_tabstop() {
-//   std::cout << "CursesScreen#set_tabstop: " << std::endl;
-// }
-// void CursesScreen::reset_tabstop() {
-//   std::cout << "CursesScreen#reset_tabstop: " << std::endl;
-// }
-// void CursesScreen::reset_all_tabstops() {
-//   std::cout << "CursesScreen#reset_all_tabstops: " << std::endl;
-// }
-// void CursesScreen::tab_right(unsigned int num) {
-//   std::cout << "CursesScreen#tab_right: " << num << std::endl;
-// }
-// void CursesScreen::tab_left(unsigned int num) {
-//   std::cout << "CursesScreen#tab_left: " << num << std::endl;
-// }
-//
-// unsigned int CursesScreen::get_cursor_x() {
-//   std::cout << "CursesScreen#get_cursor_x: " << std::endl;
-//
-//   return 1;
-// }
-// unsigned int CursesScreen::get_cursor_y() {
-//   std::cout << "CursesScreen#get_cursor_y: " << std::endl;
-//   return 2;
-// }
-//
-// void CursesScreen::erase_screen(bool protect) {
-//   std::cout << "CursesScreen#erase_screen: " << protect << std::endl;
-// }
-// void CursesScreen::erase_cursor_to_screen(bool protect) {
-//   std::cout << "CursesScreen#erase_cursor_to_screen: " << protect << std::endl;
-// }
-// void CursesScreen::erase_screen_to_cursor(bool protect) {
-//   std::cout << "CursesScreen#erase_screen_to_cursor: " << protect << std::endl;
-// }
-// void CursesScreen::erase_cursor_to_end(bool protect) {
-//   std::cout << "CursesScreen#erase_cursor_to_end: " << protect << std::endl;
-// }
-// void CursesScreen::erase_home_to_cursor(bool protect) {
-//   std::cout << "CursesScreen#erase_home_to_cursor: " << protect << std::endl;
-// }
-// void CursesScreen::erase_current_line(bool protect) {
-//   std::cout << "CursesScreen#erase_current_line: " << protect << std::endl;
-// }
-// void CursesScreen::erase_chars(unsigned int num) {
-//   std::cout << "CursesScreen#erase_chars: " << num << std::endl;
-// }
-//
-// void CursesScreen::set_margins(unsigned int top, unsigned int bottom) {
-//   std::cout << "CursesScreen#set_margins: " << top << ", " << bottom << std::endl;
-// }
-//
-// void CursesScreen::write(char c) {
-//   std::cout << "CursesScreen#write: " << c << std::endl;
-// }
+// Draw a symbol into the window, at the cursor. Nothing reaches the
+// terminal until the next update.
+void CursesScreen::put(char32_t sym, const Attr &attr) {
+  int y, x;
+  getyx(_win, y, x);
+  if (_pending_wrap) {
+    _pending_wrap = false;
+    if (_flags & SCREEN_AUTO_WRAP) {
+      if (unsigned(y) == _margin_bottom) {
+        scroll_region(1);
+      } else if (unsigned(y) + 1 < _rows) {
+        ++y;
+      }
+      x = 0;
+      wmove(_win, y, x);
+    }
+  }
+
+  wchar_t wch[2] = {(wchar_t) sym, L'\0'};
+  attr_t cattr = A_NORMAL;
+  if (attr.bold) {
+    cattr |= A_BOLD;
+  }
+  if (attr.underline) {
+    cattr |= A_UNDERLINE;
+  }
+  if (attr.inverse) {
+    cattr |= A_REVERSE;
+  }
+  if (attr.blink) {
+    cattr |= A_BLINK;
+  }
+  cchar_t cch;
+  if (setcchar(&cch, wch, cattr, 0, nullptr) != OK) {
+    _out << "Error writing symbol to screen";
+    return;
+  }
+  if (_flags & SCREEN_INSERT_MODE) {
+    wins_wch(_win, &cch);
+  } else {
+    // fails in the bottom right corner, after drawing, as the cursor cannot
+    // move on
+    wadd_wch(_win, &cch);
+  }
+  // curses wraps straight away; hold the cursor in the last column until
+  // the next print instead. A wide glyph takes two columns.
+  int width = std::max(1, unicode::width(sym));
+  if (unsigned(x + width) >= _cols) {
+    wmove(_win, y, _cols - 1);
+    _pending_wrap = true;
+  } else {
+    wmove(_win, y, x + width);
+  }
+}
+
+void CursesScreen::move(unsigned int x, unsigned int y) {
+  _pending_wrap = false;
+  wmove(_win, y, x);
+}
+
+// Scroll the scroll region up by num lines, or down if num is negative
+void CursesScreen::scroll_region(int num) {
+  int y, x;
+  getyx(_win, y, x);
+  scrollok(_win, TRUE);
+  wscrl(_win, num);
+  scrollok(_win, FALSE);
+  wmove(_win, y, x);
+}
+
+// Copy the window to the terminal
+void CursesScreen::update() {
+  wnoutrefresh(_win);
+  doupdate();
+  _last_update = std::chrono::steady_clock::now();
+}
+
+void CursesScreen::update_if_due() {
+  if (std::chrono::steady_clock::now() - _last_update >= _frame_interval) {
+    update();
+  }
+}
 
 } // namespace screen
 } // namespace vtutils
@@ -3,26 +3,36 @@
 
 #define _XOPEN_SOURCE_
 
+// Use wide characters
+#define NCURSES_WIDECHAR 1
+
+#include <chrono>
 #include <iostream>
 #include <ostream>
 #include <uchar.h>
+#include <vector>
 
 #include "config.h"
 #include "curses.h"
 #include "debug_screen.h"
 
-// Use wide characters
-#define NCURSES_WIDECHAR 1
-
 namespace vtutils {
 namespace screen {
 
+// Drawing goes to the curses window only; the terminal is updated once per
+// frame, when the Vte flushes at the end of an input batch, or when a batch
+// has been drawing for longer than the frame interval.
 class CursesScreen : public DebugScreen {
 public:
-  CursesScreen(WINDOW *win, std::ostream &out): DebugScreen(out), _win(win) {}
+  CursesScreen(WINDOW *win, std::ostream &out);
   CursesScreen(WINDOW *win): CursesScreen(win, std::cout) {}
   ~CursesScreen() = default;
 
+  // Longest time drawing may go unseen during a long input batch
+  void set_frame_interval(std::chrono::milliseconds interval) {
+    _frame_interval = interval;
+  }
+
   void reset() override;
   void hard_reset() override;
 
@@ -30,51 +40,75 @@ public:
   void reset_flags(unsigned int flags) override;
 
   void print(char32_t sym, Attr *attr) override;
-//   void newline() override;
-//   void insert_lines(unsigned int num) override;
-//   void delete_lines(unsigned int num) override;
-//   void insert_chars(unsigned int num) override;
-//   void delete_chars(unsigned int num) override;
-//   void alert() override;
-//
-//   Attr default_attr() override;
-//   void set_def_attr(Attr attr) override;
-//
-//   void move_left(unsigned int num) override;
-//   void move_right(unsigned int num) override;
-//   void move_up(unsigned int num, bool scroll) override;
-//   void move_down(unsigned int num, bool scroll) override;
-//   void move_to(unsigned int x, unsigned int y) override;
-//   void move_line_home() override;
-//
-//   void scroll_up(unsigned int num) override;
-//   void scroll_down(unsigned int num) override;
-//
-//   void set_tabstop() override;
-//   void reset_tabstop() override;
-//   void reset_all_tabstops() override;
-//   void tab_right(unsigned int num) override;
-//   void tab_left(unsigned int num) override;
-//
-//   unsigned int get_cursor_x() override;
-//   unsigned int get_cursor_y() override;
-//
-//   void erase_screen(bool protect) override;
-//   void erase_cursor_to_screen(bool protect) override;
-//   void erase_screen_to_cursor(bool protect) override;
-//   void erase_cursor_to_end(bool protect) override;
-//   void erase_home_to_cursor(bool protect) override;
-//   void erase_current_line(bool protect) override;
-//   void erase_chars(unsigned int num) override;
-//
-//   void set_margins(unsigned int top, unsigned int bottom) override;
-//
-//   void write(char sym) override;
-  
+  void print_run(const char32_t *syms, size_t num, const Attr &attr) override;
+  void newline() override;
+  void insert_lines(unsigned int num) override;
+  void delete_lines(unsigned int num) override;
+  void insert_chars(unsigned int num) override;
+  void delete_chars(unsigned int num) override;
+  void alert() override;
+
+  Attr default_attr() override;
+  void set_def_attr(Attr attr) override;
+
+  void move_left(unsigned int num) override;
+  void move_right(unsigned int num) override;
+  void move_up(unsigned int num, bool scroll) override;
+  void move_down(unsigned int num, bool scroll) override;
+  void move_to(unsigned int x, unsigned int y) override;
+  void move_line_home() override;
+
+  void scroll_up(unsigned int num) override;
+  void scroll_down(unsigned int num) override;
+
+  void set_tabstop() override;
+  void reset_tabstop() override;
+  void reset_all_tabstops() override;
+  void tab_right(unsigned int num) override;
+  void tab_left(unsigned int num) override;
+
+  unsigned int get_cursor_x() override;
+  unsigned int get_cursor_y() override;
+
+  void erase_screen(bool protect) override;
+  void erase_cursor_to_screen(bool protect) override;
+  void erase_screen_to_cursor(bool protect) override;
+  void erase_cursor_to_end(bool protect) override;
+  void erase_home_to_cursor(bool protect) override;
+  void erase_current_line(bool protect) override;
+  void erase_chars(unsigned int num) override;
+
+  void set_margins(unsigned int top, unsigned int bottom) override;
+  // Resizes the window too
+  void resize(unsigned int cols, unsigned int rows) override;
+
+  void flush() override;
+
 private:
   typedef DebugScreen _super;
   WINDOW *const _win;
-  unsigned int _flags;
+  unsigned int _flags = 0;
+  std::chrono::milliseconds _frame_interval{50};
+  std::chrono::steady_clock::time_point _last_update;
+
+  // window size
+  unsigned int _cols;
+  unsigned int _rows;
+  // scroll region, inclusive; mirrors the window's wsetscrreg
+  unsigned int _margin_top;
+  unsigned int _margin_bottom;
+  // set after printing in the last column: curses has already wrapped, but
+  // the terminal only wraps on the next print
+  bool _pending_wrap = false;
+  std::vector<bool> _tabs;
+  Attr _def_attr{};
+
+  void put(char32_t sym, const Attr &attr);
+  // Move the window cursor, dropping any pending wrap
+  void move(unsigned int x, unsigned int y);
+  void scroll_region(int num);
+  void update();
+  void update_if_due();
 };
 
 } // namespace screen
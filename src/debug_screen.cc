@@ -3,6 +3,8 @@
 #include <iostream>
 #include <typeinfo>
 
+#include "unicode.h"
+
 namespace vtutils {
 namespace screen {
 
@@ -23,6 +25,22 @@ void DebugScreen::reset_flags(unsigned int flags) {
 void DebugScreen::print(char32_t sym, Attr *attr) {
   _out << class_name() << "#print: " << sym << ", " << *attr << std::endl;
 }
+void DebugScreen::print_run(const char32_t *syms, size_t num, const Attr &attr) {
+  char u8[4];
+  _out << class_name() << "#print_run: \"";
+  for (size_t i = 0; i < num; ++i) {
+    _out.write(u8, unicode::Utf8To32Converter::reverse(u8, syms[i]));
+  }
+  _out << "\", " << attr << std::endl;
+}
+void DebugScreen::print_cluster(const char32_t *syms, size_t num, const Attr &attr) {
+  char u8[4];
+  _out << class_name() << "#print_cluster: \"";
+  for (size_t i = 0; i < num; ++i) {
+    _out.write(u8, unicode::Utf8To32Converter::reverse(u8, syms[i]));
+  }
+  _out << "\", " << attr << std::endl;
+}
 void DebugScreen::newline() {
   _out << class_name() << "#newline: " << std::endl;
 }
@@ -128,9 +146,41 @@ void DebugScreen::erase_chars(unsigned int num) {
 void DebugScreen::set_margins(unsigned int top, unsigned int bottom) {
   _out << class_name() << "#set_margins: " << top << ", " << bottom << std::endl;
 }
+void DebugScreen::resize(unsigned int cols, unsigned int rows) {
+  _out << class_name() << "#resize: " << cols << ", " << rows << std::endl;
+}
 void DebugScreen::write(char c) {
   _out << class_name() << "#write: " << c << std::endl;
 }
+void DebugScreen::write(const char *data, size_t len) {
+  _out << class_name() << "#write: ";
+  _out.write(data, len);
+  _out << std::endl;
+}
+void DebugScreen::osc(int command, std::string_view data) {
+  _out << class_name() << "#osc: " << command << ", " << data << std::endl;
+}
+void DebugScreen::dcs_start(
+    char32_t final,
+    std::string_view intermediates,
+    const int *params,
+    unsigned int num_params) {
+  _out << class_name() << "#dcs_start: " << final << ", " << intermediates;
+  for (unsigned int i = 0; i < num_params; ++i) {
+    _out << ", " << params[i];
+  }
+  _out << std::endl;
+}
+void DebugScreen::dcs_data(std::string_view data) {
+  _out << class_name() << "#dcs_data: " << data << std::endl;
+}
+void DebugScreen::dcs_end(bool aborted) {
+  _out << class_name() << "#dcs_end: " << aborted << std::endl;
+}
+
+void DebugScreen::flush() {
+  _out << class_name() << "#flush" << std::endl;
+}
 
 } // namespace screen
 } // namespace vtutils
@@ -25,6 +25,14 @@ public:
   virtual void reset_flags(unsigned int flags) override;
 
   virtual void print(char32_t sym, Attr *attr) override;
+  virtual void print_run(
+      const char32_t *syms,
+      size_t num,
+      const Attr &attr) override;
+  virtual void print_cluster(
+      const char32_t *syms,
+      size_t num,
+      const Attr &attr) override;
   virtual void newline() override;
   virtual void insert_lines(unsigned int num) override;
   virtual void delete_lines(unsigned int num) override;
@@ -63,8 +71,20 @@ public:
   virtual void erase_chars(unsigned int num) override;
   
   virtual void set_margins(unsigned int top, unsigned int bottom) override;
+  virtual void resize(unsigned int cols, unsigned int rows) override;
 
   virtual void write(char sym) override;
+  virtual void write(const char *data, size_t len) override;
+  virtual void osc(int command, std::string_view data) override;
+  virtual void dcs_start(
+      char32_t final,
+      std::string_view intermediates,
+      const int *params,
+      unsigned int num_params) override;
+  virtual void dcs_data(std::string_view data) override;
+  virtual void dcs_end(bool aborted) override;
+
+  virtual void flush() override;
   
   std::string class_name() {
     if (_class_name.empty()) {
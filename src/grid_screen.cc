@@ -0,0 +1,1092 @@
+#include "grid_screen.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "scrollback.h"
+#include "unicode.h"
+
+namespace vtutils {
+namespace screen {
+
+// distance between the default tab stops
+static const unsigned int TAB_WIDTH = 8;
+// smallest attribute table size that triggers a garbage collection
+static const size_t ATTR_GC_MIN = 256;
+// and the same for the cluster table
+static const size_t CLUSTER_GC_MIN = 1024;
+
+GridScreen::GridScreen(unsigned int cols, unsigned int rows)
+    : _cols(cols ? cols : 1),
+      _rows(rows ? rows : 1),
+      _last_attr{},
+      _last_id(DEFAULT_ATTR_ID),
+      _gc_threshold(ATTR_GC_MIN),
+      _cluster_gc_threshold(CLUSTER_GC_MIN),
+      _flags(0),
+      _cursor_x(0),
+      _cursor_y(0),
+      _tabs(_cols),
+      _def_attr{},
+      _def_id(DEFAULT_ATTR_ID),
+      _damage_begin(_rows),
+      _damage_end(_rows) {
+  for (Buffer *buf : {&_buf, &_other}) {
+    buf->chars.assign(_cols * _rows, EMPTY_CELL);
+    buf->attrs.assign(_cols * _rows, DEFAULT_ATTR_ID);
+    buf->row_map.resize(_rows);
+    for (unsigned int y = 0; y < _rows; ++y) {
+      buf->row_map[y] = y;
+    }
+    buf->row_gen.assign(_rows, 0);
+    buf->wrapped.assign(_rows, 0);
+  }
+  reset();
+  damage_all();
+}
+
+void GridScreen::reset() {
+  // a soft reset stays on the alternate screen
+  _flags &= SCREEN_ALTERNATE;
+  unrotate(_buf);
+  unrotate(_other);
+  _margin_top = 0;
+  _margin_bottom = _rows - 1;
+  for (unsigned int i = 0; i < _cols; ++i) {
+    _tabs[i] = i % TAB_WIDTH == 0;
+  }
+}
+void GridScreen::hard_reset() {
+  reset_flags(SCREEN_ALTERNATE);
+  reset();
+  _other.gen++;
+  _other.blank_id = _def_id;
+  erase_screen(false);
+  _cursor_x = 0;
+  _cursor_y = 0;
+}
+
+void GridScreen::set_flags(unsigned int flags) {
+  if (~_flags & flags & SCREEN_INVERSE) {
+    damage_all();
+  }
+  if (~_flags & flags & SCREEN_ALTERNATE) {
+    switch_buffer();
+  }
+  _flags |= flags;
+}
+void GridScreen::reset_flags(unsigned int flags) {
+  if (_flags & flags & SCREEN_INVERSE) {
+    damage_all();
+  }
+  if (_flags & flags & SCREEN_ALTERNATE) {
+    switch_buffer();
+    _cursor_x = _buf.saved_x;
+    _cursor_y = _buf.saved_y;
+  }
+  _flags &= ~flags;
+}
+
+void GridScreen::print(char32_t sym, Attr *attr) {
+  put(sym, intern(*attr));
+}
+void GridScreen::print_run(const char32_t *syms, size_t num, const Attr &attr) {
+  attr_id id = intern(attr);
+  for (size_t i = 0; i < num; ++i) {
+    put(syms[i], id);
+  }
+}
+void GridScreen::print_cluster(const char32_t *syms, size_t num, const Attr &attr) {
+  put_cluster(syms, num, intern(attr));
+}
+
+void GridScreen::newline() {
+  move_down(1, true);
+  move_line_home();
+}
+
+void GridScreen::insert_lines(unsigned int num) {
+  if (_cursor_y < _margin_top || _cursor_y > _margin_bottom) {
+    return;
+  }
+  unsigned int max = _margin_bottom - _cursor_y + 1;
+  num = std::min(num, max);
+  rotate_lines(_cursor_y, _margin_bottom, num);
+  clear_cells(_cursor_y * _cols, (_cursor_y + num) * _cols, false);
+  _cursor_x = 0;
+}
+void GridScreen::delete_lines(unsigned int num) {
+  if (_cursor_y < _margin_top || _cursor_y > _margin_bottom) {
+    return;
+  }
+  unsigned int max = _margin_bottom - _cursor_y + 1;
+  num = std::min(num, max);
+  rotate_lines(_cursor_y, _margin_bottom, -int(num));
+  clear_cells(
+      (_margin_bottom + 1 - num) * _cols,
+      (_margin_bottom + 1) * _cols,
+      false);
+  _cursor_x = 0;
+}
+
+void GridScreen::insert_chars(unsigned int num) {
+  clamp_cursor();
+  unsigned int max = _cols - _cursor_x;
+  num = std::min(num, max);
+  split_wide(_cursor_y, _cursor_x);
+  split_wide(_cursor_y, _cols - num);
+  unsigned int pos = row_start(_cursor_y) + _cursor_x;
+  std::memmove(_buf.chars.data() + pos + num, _buf.chars.data() + pos, (max - num) * sizeof(char32_t));
+  std::memmove(_buf.attrs.data() + pos + num, _buf.attrs.data() + pos, (max - num) * sizeof(attr_id));
+  std::fill_n(_buf.chars.data() + pos, num, EMPTY_CELL);
+  std::fill_n(_buf.attrs.data() + pos, num, _def_id);
+  damage(_cursor_y, _cursor_x, _cols);
+}
+void GridScreen::delete_chars(unsigned int num) {
+  clamp_cursor();
+  unsigned int max = _cols - _cursor_x;
+  num = std::min(num, max);
+  split_wide(_cursor_y, _cursor_x);
+  split_wide(_cursor_y, _cursor_x + num);
+  unsigned int pos = row_start(_cursor_y) + _cursor_x;
+  std::memmove(_buf.chars.data() + pos, _buf.chars.data() + pos + num, (max - num) * sizeof(char32_t));
+  std::memmove(_buf.attrs.data() + pos, _buf.attrs.data() + pos + num, (max - num) * sizeof(attr_id));
+  std::fill_n(_buf.chars.data() + pos + max - num, num, EMPTY_CELL);
+  std::fill_n(_buf.attrs.data() + pos + max - num, num, _def_id);
+  damage(_cursor_y, _cursor_x, _cols);
+}
+
+void GridScreen::alert() {
+  ++_bell_count;
+}
+
+Attr GridScreen::default_attr() {
+  return _def_attr;
+}
+void GridScreen::set_def_attr(Attr attr) {
+  _def_attr = attr;
+  _def_id = intern(attr);
+}
+
+void GridScreen::move_left(unsigned int num) {
+  clamp_cursor();
+  _cursor_x -= std::min(num, _cursor_x);
+}
+void GridScreen::move_right(unsigned int num) {
+  num = std::min(num, _cols);
+  _cursor_x = std::min(_cursor_x + num, _cols - 1);
+}
+void GridScreen::move_up(unsigned int num, bool scroll) {
+  unsigned int top = _cursor_y >= _margin_top ? _margin_top : 0;
+  unsigned int diff = _cursor_y - top;
+  if (num > diff) {
+    if (scroll) {
+      scroll_down(num - diff);
+    }
+    _cursor_y = top;
+  } else {
+    _cursor_y -= num;
+  }
+  clamp_cursor();
+}
+void GridScreen::move_down(unsigned int num, bool scroll) {
+  unsigned int bottom = _cursor_y <= _margin_bottom ? _margin_bottom : _rows - 1;
+  unsigned int diff = bottom - _cursor_y;
+  if (num > diff) {
+    if (scroll) {
+      scroll_up(num - diff);
+    }
+    _cursor_y = bottom;
+  } else {
+    _cursor_y += num;
+  }
+  clamp_cursor();
+}
+void GridScreen::move_to(unsigned int x, unsigned int y) {
+  unsigned int last = _rows - 1;
+  if (_flags & SCREEN_REL_ORIGIN) {
+    y += _margin_top;
+    last = _margin_bottom;
+  }
+  _cursor_x = std::min(x, _cols - 1);
+  _cursor_y = std::min(y, last);
+}
+void GridScreen::move_line_home() {
+  _cursor_x = 0;
+}
+
+void GridScreen::scroll_up(unsigned int num) {
+  unsigned int height = _margin_bottom - _margin_top + 1;
+  num = std::min(num, height);
+  // like xterm, only a region at the top of the main screen feeds the
+  // history
+  if (_scrollback && _margin_top == 0 && !(_flags & SCREEN_ALTERNATE)) {
+    for (unsigned int y = 0; y < num; ++y) {
+      _scrollback->push(
+          row_chars(y),
+          row_attrs(y),
+          _cols,
+          _attr_table,
+          _cluster_table,
+          row_wrapped(y));
+    }
+  }
+  rotate_lines(_margin_top, _margin_bottom, -int(num));
+  clear_cells(
+      (_margin_bottom + 1 - num) * _cols,
+      (_margin_bottom + 1) * _cols,
+      false);
+}
+void GridScreen::scroll_down(unsigned int num) {
+  unsigned int height = _margin_bottom - _margin_top + 1;
+  num = std::min(num, height);
+  rotate_lines(_margin_top, _margin_bottom, num);
+  clear_cells(_margin_top * _cols, (_margin_top + num) * _cols, false);
+}
+
+void GridScreen::set_tabstop() {
+  if (_cursor_x < _cols) {
+    _tabs[_cursor_x] = true;
+  }
+}
+void GridScreen::reset_tabstop() {
+  if (_cursor_x < _cols) {
+    _tabs[_cursor_x] = false;
+  }
+}
+void GridScreen::reset_all_tabstops() {
+  std::fill(_tabs.begin(), _tabs.end(), false);
+}
+void GridScreen::tab_right(unsigned int num) {
+  for (unsigned int i = 0; i < num && _cursor_x + 1 < _cols; ++i) {
+    unsigned int x = _cursor_x + 1;
+    while (x < _cols - 1 && !_tabs[x]) {
+      ++x;
+    }
+    _cursor_x = x;
+  }
+  // tabs never cause a pending wrap
+  clamp_cursor();
+}
+void GridScreen::tab_left(unsigned int num) {
+  clamp_cursor();
+  for (unsigned int i = 0; i < num && _cursor_x > 0; ++i) {
+    unsigned int x = _cursor_x - 1;
+    while (x > 0 && !_tabs[x]) {
+      --x;
+    }
+    _cursor_x = x;
+  }
+}
+
+unsigned int GridScreen::get_cursor_x() {
+  return _cursor_x;
+}
+unsigned int GridScreen::get_cursor_y() {
+  return _cursor_y;
+}
+
+void GridScreen::erase_screen(bool protect) {
+  if (protect) {
+    clear_cells(0, _cols * _rows, protect);
+    return;
+  }
+  // every row is now of an older generation, so blank
+  _buf.gen++;
+  _buf.blank_id = _def_id;
+  damage_all();
+}
+void GridScreen::erase_cursor_to_screen(bool protect) {
+  unsigned int x = std::min(_cursor_x, _cols - 1);
+  clear_cells(_cursor_y * _cols + x, _cols * _rows, protect);
+}
+void GridScreen::erase_screen_to_cursor(bool protect) {
+  unsigned int x = std::min(_cursor_x, _cols - 1);
+  clear_cells(0, _cursor_y * _cols + x + 1, protect);
+}
+void GridScreen::erase_cursor_to_end(bool protect) {
+  unsigned int x = std::min(_cursor_x, _cols - 1);
+  clear_cells(_cursor_y * _cols + x, (_cursor_y + 1) * _cols, protect);
+}
+void GridScreen::erase_home_to_cursor(bool protect) {
+  unsigned int x = std::min(_cursor_x, _cols - 1);
+  clear_cells(_cursor_y * _cols, _cursor_y * _cols + x + 1, protect);
+}
+void GridScreen::erase_current_line(bool protect) {
+  clear_cells(_cursor_y * _cols, (_cursor_y + 1) * _cols, protect);
+}
+void GridScreen::erase_chars(unsigned int num) {
+  unsigned int x = std::min(_cursor_x, _cols - 1);
+  num = std::min(num, _cols - x);
+  clear_cells(_cursor_y * _cols + x, _cursor_y * _cols + x + num, false);
+}
+
+void GridScreen::set_margins(unsigned int top, unsigned int bottom) {
+  // top and bottom are 1-based, as sent by the application; 0 selects the
+  // default
+  unrotate(_buf);
+  unrotate(_other);
+  if (top == 0) {
+    top = 1;
+  }
+  if (bottom == 0) {
+    bottom = _rows;
+  }
+  if (bottom <= top || bottom > _rows) {
+    _margin_top = 0;
+    _margin_bottom = _rows - 1;
+  } else {
+    _margin_top = top - 1;
+    _margin_bottom = bottom - 1;
+  }
+  move_to(0, 0);
+}
+
+void GridScreen::resize(unsigned int cols, unsigned int rows) {
+  cols = cols ? cols : 1;
+  rows = rows ? rows : 1;
+  if (cols == _cols && rows == _rows) {
+    return;
+  }
+
+  unrotate(_buf);
+  unrotate(_other);
+  _buf.saved_x = _cursor_x;
+  _buf.saved_y = _cursor_y;
+  if (_flags & SCREEN_ALTERNATE) {
+    reflow(_other, cols, rows);
+    crop(_buf, cols, rows);
+  } else {
+    reflow(_buf, cols, rows);
+    crop(_other, cols, rows);
+  }
+  _cursor_x = _buf.saved_x;
+  _cursor_y = _buf.saved_y;
+
+  unsigned int old_cols = _cols;
+  _cols = cols;
+  _rows = rows;
+  _margin_top = 0;
+  _margin_bottom = _rows - 1;
+  _tabs.resize(_cols);
+  for (unsigned int i = old_cols; i < _cols; ++i) {
+    _tabs[i] = i % TAB_WIDTH == 0;
+  }
+
+  _damage_begin.assign(_rows, 0);
+  _damage_end.assign(_rows, 0);
+  _scroll_damage.clear();
+  damage_all();
+  if (_shared) {
+    _unpublished.assign(_rows, true);
+    publish();
+  }
+}
+
+void GridScreen::write(char sym) {
+  _output.push_back(sym);
+}
+void GridScreen::write(const char *data, size_t len) {
+  _output.append(data, len);
+}
+
+void wrap_line(
+    const char32_t *chars,
+    size_t num,
+    unsigned int width,
+    std::vector<size_t> &starts) {
+  starts.assign(1, 0);
+  width = std::max(width, 1u);
+  unsigned int x = 0;
+  for (size_t i = 0; i < num;) {
+    // a wide character takes its head and tail cells, unless there is a
+    // single column, where the tail goes on a row of its own
+    unsigned int w = (i + 1 < num && chars[i + 1] == WIDE_TAIL_CELL) ? 2 : 1;
+    w = std::min(w, width);
+    if (x + w > width) {
+      starts.push_back(i);
+      x = 0;
+    }
+    x += w;
+    i += w;
+  }
+}
+
+// A row of cols cells as utf-8, with trailing empty cells dropped. Cluster
+// cells are looked up in clusters.
+static std::string row_to_utf8(
+    const char32_t *row,
+    unsigned int cols,
+    const ClusterTable *clusters) {
+  while (cols > 0 && row[cols - 1] == EMPTY_CELL) {
+    --cols;
+  }
+
+  std::string out;
+  char u8[4];
+  for (unsigned int x = 0; x < cols; ++x) {
+    if (row[x] == WIDE_TAIL_CELL) {
+      continue;
+    }
+    if (row[x] == EMPTY_CELL) {
+      out.push_back(' ');
+    } else if (row[x] & CLUSTER_CELL) {
+      for (char32_t sym : (*clusters)[row[x] & ~CLUSTER_CELL]) {
+        out.append(u8, unicode::Utf8To32Converter::reverse(u8, sym));
+      }
+    } else {
+      out.append(u8, unicode::Utf8To32Converter::reverse(u8, row[x]));
+    }
+  }
+  return out;
+}
+
+std::string GridScreen::line(unsigned int y) const {
+  return row_to_utf8(row_chars(y), _cols, &_cluster_table);
+}
+
+void GridScreen::flush() {
+  if (_shared) {
+    publish();
+  }
+}
+
+// Attributes are published packed into 64 bits, so each cell is a single
+// atomic: color codes in 5 bits, RGB values in 24, for each color, then the
+// flags.
+static uint64_t pack_color(const Color &color) {
+  uint64_t packed = uint8_t(color.color_code) & 0x1f;
+  if (color.color_code == COLOR_CODE_RGB) {
+    packed |= uint64_t(color.r) << 5 | uint64_t(color.g) << 13 | uint64_t(color.b) << 21;
+  }
+  return packed;
+}
+static Color unpack_color(uint64_t packed) {
+  Color color{};
+  // sign extend the code, for COLOR_CODE_RGB
+  color.color_code = ColorCode(int8_t(uint8_t(packed << 3)) >> 3);
+  color.r = packed >> 5;
+  color.g = packed >> 13;
+  color.b = packed >> 21;
+  return color;
+}
+static uint64_t pack_attr(const Attr &attr) {
+  return pack_color(attr.fg)
+      | pack_color(attr.bg) << 29
+      | uint64_t(attr.bold) << 58
+      | uint64_t(attr.underline) << 59
+      | uint64_t(attr.inverse) << 60
+      | uint64_t(attr.protect) << 61
+      | uint64_t(attr.blink) << 62;
+}
+static Attr unpack_attr(uint64_t packed) {
+  Attr attr{};
+  attr.fg = unpack_color(packed & 0x1fffffff);
+  attr.bg = unpack_color(packed >> 29 & 0x1fffffff);
+  attr.bold = packed >> 58 & 1;
+  attr.underline = packed >> 59 & 1;
+  attr.inverse = packed >> 60 & 1;
+  attr.protect = packed >> 61 & 1;
+  attr.blink = packed >> 62 & 1;
+  return attr;
+}
+
+void GridScreen::enable_snapshots() {
+  if (_shared) {
+    return;
+  }
+  _shared.reset(new Shared);
+  _unpublished.assign(_rows, true);
+  publish();
+}
+
+void GridScreen::publish() {
+  if (!_shared) {
+    return;
+  }
+  Shared &shared = *_shared;
+  uint64_t seq = shared.seq.load(std::memory_order_relaxed);
+  shared.seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  size_t num = size_t(_cols) * _rows;
+  Shared::Cells *cells = shared.cells.load(std::memory_order_relaxed);
+  if (!cells || cells->capacity < num) {
+    size_t capacity = std::max(num, cells ? 2 * cells->capacity : 0);
+    shared.all_cells.emplace_back(new Shared::Cells{
+        capacity,
+        std::unique_ptr<std::atomic<char32_t>[]>(new std::atomic<char32_t>[capacity]()),
+        std::unique_ptr<std::atomic<uint64_t>[]>(new std::atomic<uint64_t>[capacity]()),
+    });
+    cells = shared.all_cells.back().get();
+    shared.cells.store(cells, std::memory_order_release);
+    _unpublished.assign(_rows, true);
+  }
+  shared.cols.store(_cols, std::memory_order_relaxed);
+  shared.rows.store(_rows, std::memory_order_relaxed);
+
+  for (unsigned int y = 0; y < _rows; ++y) {
+    if (!_unpublished[y]) {
+      continue;
+    }
+    _unpublished[y] = false;
+    const char32_t *chars = row_chars(y);
+    const attr_id *attrs = row_attrs(y);
+    for (unsigned int x = 0; x < _cols; ++x) {
+      unsigned int i = y * _cols + x;
+      cells->chars[i].store(cell_text(chars[x])[0], std::memory_order_relaxed);
+      cells->attrs[i].store(pack_attr(_attr_table[attrs[x]]), std::memory_order_relaxed);
+    }
+  }
+  shared.cursor_x.store(std::min(_cursor_x, _cols - 1), std::memory_order_relaxed);
+  shared.cursor_y.store(_cursor_y, std::memory_order_relaxed);
+
+  shared.seq.store(seq + 2, std::memory_order_release);
+}
+
+bool GridScreen::read_snapshot(GridSnapshot &snapshot) const {
+  if (!_shared) {
+    return false;
+  }
+  const Shared &shared = *_shared;
+
+  for (;;) {
+    uint64_t seq = shared.seq.load(std::memory_order_acquire);
+    if (seq & 1) {
+      std::this_thread::yield();
+      continue;
+    }
+    const Shared::Cells *cells = shared.cells.load(std::memory_order_acquire);
+    unsigned int cols = shared.cols.load(std::memory_order_relaxed);
+    unsigned int rows = shared.rows.load(std::memory_order_relaxed);
+    size_t num = size_t(cols) * rows;
+    if (num > cells->capacity) {
+      // the size of a later publish, with the cells of an earlier one
+      continue;
+    }
+    snapshot.chars.resize(num);
+    snapshot.attrs.resize(num);
+    for (size_t i = 0; i < num; ++i) {
+      snapshot.chars[i] = cells->chars[i].load(std::memory_order_relaxed);
+      snapshot.attrs[i] = unpack_attr(cells->attrs[i].load(std::memory_order_relaxed));
+    }
+    snapshot.cursor_x = shared.cursor_x.load(std::memory_order_relaxed);
+    snapshot.cursor_y = shared.cursor_y.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (shared.seq.load(std::memory_order_relaxed) == seq) {
+      snapshot.cols = cols;
+      snapshot.rows = rows;
+      snapshot.generation = seq / 2;
+      return true;
+    }
+  }
+}
+
+std::string GridSnapshot::line(unsigned int y) const {
+  return row_to_utf8(&chars[y * cols], cols, nullptr);
+}
+
+Damage GridScreen::collect_damage() {
+  Damage damage;
+  damage.scrolls.swap(_scroll_damage);
+  for (unsigned int y = 0; y < _rows; ++y) {
+    unsigned int row = storage_row(y);
+    if (_damage_begin[row] < _damage_end[row]) {
+      damage.rows.push_back(RowDamage{y, _damage_begin[row], _damage_end[row]});
+      _damage_begin[row] = 0;
+      _damage_end[row] = 0;
+    }
+  }
+  return damage;
+}
+
+std::string GridScreen::take_output() {
+  std::string out;
+  out.swap(_output);
+  return out;
+}
+
+// Returns the ID for attr, adding it to the attribute table if needed
+attr_id GridScreen::intern(const Attr &attr) {
+  if (attr == _last_attr) {
+    return _last_id;
+  }
+  if (_attr_table.size() >= _gc_threshold) {
+    collect_attrs();
+  }
+  _last_attr = attr;
+  _last_id = _attr_table.intern(attr);
+  return _last_id;
+}
+
+// Frees the attribute IDs no longer referenced by any cell. The cost is one
+// pass over the grid, and the threshold doubles with the live set, so it is
+// amortized over at least as many new attributes as are still in use.
+void GridScreen::collect_attrs() {
+  for (const Buffer *buf : {&_buf, &_other}) {
+    for (attr_id id : buf->attrs) {
+      _attr_table.mark(id);
+    }
+    _attr_table.mark(buf->blank_id);
+  }
+  _attr_table.mark(_last_id);
+  _attr_table.mark(_def_id);
+  size_t live = _attr_table.sweep();
+  _gc_threshold = std::min(std::max(ATTR_GC_MIN, 2 * live), AttrTable::MAX_SIZE);
+}
+
+// Sets id to the ID of a cluster, collecting the unused clusters first if
+// the table has grown enough. Returns false if the table is full.
+bool GridScreen::intern_cluster(const char32_t *syms, size_t num, cluster_id &id) {
+  if (_cluster_table.size() >= _cluster_gc_threshold) {
+    collect_clusters();
+  }
+  return _cluster_table.intern(syms, num, id);
+}
+
+// Frees the clusters no longer held by any cell, as collect_attrs
+void GridScreen::collect_clusters() {
+  for (const Buffer *buf : {&_buf, &_other}) {
+    for (char32_t cell : buf->chars) {
+      if (cell & CLUSTER_CELL) {
+        _cluster_table.mark(cell & ~CLUSTER_CELL);
+      }
+    }
+  }
+  size_t live = _cluster_table.sweep();
+  _cluster_gc_threshold = std::min(
+      std::max(CLUSTER_GC_MIN, 2 * live),
+      ClusterTable::MAX_SIZE);
+}
+
+void GridScreen::put(char32_t sym, attr_id id) {
+  int width = unicode::width(sym);
+  if (width == 0 || extends_previous(sym)) {
+    combine(&sym, 1);
+  } else {
+    put_cell(sym, width, id);
+  }
+}
+
+void GridScreen::put_cluster(const char32_t *syms, size_t num, attr_id id) {
+  if (unicode::width(syms[0]) == 0 || extends_previous(syms[0])) {
+    // the rest of a cluster printed before
+    combine(syms, num);
+    return;
+  }
+  char32_t cell = syms[0];
+  cluster_id cluster;
+  if (num > 1 && intern_cluster(syms, num, cluster)) {
+    cell = CLUSTER_CELL | cluster;
+  }
+  put_cell(cell, unicode::width(syms, num), id);
+}
+
+// The character before the cursor, or nullptr if there is none. Sets x to
+// its column.
+char32_t *GridScreen::cell_before_cursor(unsigned int &x) {
+  x = std::min(_cursor_x, _cols);
+  if (x == 0) {
+    return nullptr;
+  }
+  unsigned int start = row_start(_cursor_y);
+  --x;
+  if (_buf.chars[start + x] == WIDE_TAIL_CELL) {
+    --x;
+  }
+  char32_t *cell = &_buf.chars[start + x];
+  return (*cell == EMPTY_CELL) ? nullptr : cell;
+}
+
+// true if sym continues the cluster of the character before the cursor.
+// The Vte only groups the code points of one input call, so an emoji
+// modifier, or the code point after a zero width joiner, can arrive after
+// the rest of its cluster was printed.
+bool GridScreen::extends_previous(char32_t sym) {
+  if (sym < 0x300) {
+    return false;
+  }
+  unsigned int x;
+  const char32_t *cell = cell_before_cursor(x);
+  return cell && unicode::extends_cluster(cell_text(*cell).back(), sym);
+}
+
+// Add the code points at syms, combining code points printed on their own,
+// to the character before the cursor. They are dropped if there is none.
+void GridScreen::combine(const char32_t *syms, size_t num) {
+  unsigned int x;
+  char32_t *found = cell_before_cursor(x);
+  if (!found) {
+    return;
+  }
+  unsigned int end = std::min(_cursor_x, _cols);
+  char32_t &cell = *found;
+
+  char32_t cluster[ClusterTable::MAX_LENGTH];
+  std::u32string_view base = cell_text(cell);
+  size_t len = std::min(base.size(), ClusterTable::MAX_LENGTH);
+  std::copy_n(base.begin(), len, cluster);
+  num = std::min(num, ClusterTable::MAX_LENGTH - len);
+  std::copy_n(syms, num, cluster + len);
+  cluster_id id;
+  if (num > 0 && intern_cluster(cluster, len + num, id)) {
+    cell = CLUSTER_CELL | id;
+    damage(_cursor_y, x, end);
+  }
+}
+
+// write a cell at the cursor, wrapping and scrolling as needed
+void GridScreen::put_cell(char32_t cell, unsigned int width, attr_id id) {
+  // a wide character on a single column screen gets the one cell
+  width = std::min(width, _cols);
+  unsigned int last = (_cursor_y <= _margin_bottom) ? _margin_bottom : _rows - 1;
+
+  // like xterm, a wide character that does not fit in the last column
+  // wraps, leaving the column as it was
+  if (_cursor_x + width > _cols) {
+    if (_flags & SCREEN_AUTO_WRAP) {
+      _buf.wrapped[storage_row(_cursor_y)] = true;
+      _cursor_x = 0;
+      ++_cursor_y;
+    } else {
+      _cursor_x = _cols - width;
+    }
+  }
+  if (_cursor_y > last) {
+    _cursor_y = last;
+    scroll_up(1);
+  }
+
+  split_wide(_cursor_y, _cursor_x);
+  if (_flags & SCREEN_INSERT_MODE) {
+    split_wide(_cursor_y, _cols - width);
+  } else {
+    split_wide(_cursor_y, _cursor_x + width);
+  }
+  unsigned int pos = row_start(_cursor_y) + _cursor_x;
+  if (_flags & SCREEN_INSERT_MODE) {
+    unsigned int move = _cols - _cursor_x - width;
+    std::memmove(_buf.chars.data() + pos + width, _buf.chars.data() + pos, move * sizeof(char32_t));
+    std::memmove(_buf.attrs.data() + pos + width, _buf.attrs.data() + pos, move * sizeof(attr_id));
+  }
+  _buf.chars[pos] = cell;
+  _buf.attrs[pos] = id;
+  if (width == 2) {
+    _buf.chars[pos + 1] = WIDE_TAIL_CELL;
+    _buf.attrs[pos + 1] = id;
+  }
+  damage(_cursor_y, _cursor_x, (_flags & SCREEN_INSERT_MODE) ? _cols : _cursor_x + width);
+  _cursor_x += width;
+}
+
+// Erase the cells [from, to), by row-major index. With protect set, cells
+// with protected attributes are kept.
+void GridScreen::clear_cells(unsigned int from, unsigned int to, bool protect) {
+  for (unsigned int y = from / _cols; y * _cols < to; ++y) {
+    unsigned int begin = std::max(from, y * _cols) - y * _cols;
+    unsigned int end = std::min(to, (y + 1) * _cols) - y * _cols;
+    split_wide(y, begin);
+    split_wide(y, end);
+    damage(y, begin, end);
+    if (end == _cols) {
+      _buf.wrapped[storage_row(y)] = false;
+    }
+
+    unsigned int start = row_start(y);
+    for (unsigned int i = start + begin; i < start + end; ++i) {
+      if (protect && _attr_table[_buf.attrs[i]].protect) {
+        continue;
+      }
+      _buf.chars[i] = EMPTY_CELL;
+      _buf.attrs[i] = _def_id;
+    }
+  }
+}
+
+// Erase the wide character split by the boundary before column x of row y,
+// if any, so that x can be written to (or moved away from) on its own
+void GridScreen::split_wide(unsigned int y, unsigned int x) {
+  if (x == 0 || x >= _cols) {
+    return;
+  }
+  unsigned int pos = row_start(y) + x;
+  if (_buf.chars[pos] == WIDE_TAIL_CELL) {
+    _buf.chars[pos - 1] = EMPTY_CELL;
+    _buf.chars[pos] = EMPTY_CELL;
+    damage(y, x - 1, x + 1);
+  }
+}
+
+// Move rows top to bottom (inclusive) by delta rows, down if positive,
+// within the scroll region. The rows pushed out at one end come back in at
+// the other, and are cleared by the caller.
+void GridScreen::rotate_lines(unsigned int top, unsigned int bottom, int delta) {
+  unsigned int height = bottom - top + 1;
+  unsigned int num = std::abs(delta);
+  if (num == 0 || num >= height) {
+    return;
+  }
+  if (top == _margin_top && bottom == _margin_bottom) {
+    // the whole region: turn the ring
+    _buf.rotation = (_buf.rotation + (delta < 0 ? num : height - num)) % height;
+  } else {
+    unrotate(_buf);
+    auto first = _buf.row_map.begin() + top;
+    auto last = first + height;
+    std::rotate(first, delta < 0 ? first + num : last - num, last);
+  }
+  // the damage is kept by storage row, so it has moved with the rows
+  damage_scroll(top, bottom, delta);
+}
+
+// Put the rows of the scroll region back in screen order, before the
+// region changes
+void GridScreen::unrotate(Buffer &buf) {
+  if (buf.rotation == 0) {
+    return;
+  }
+  auto first = buf.row_map.begin() + _margin_top;
+  std::rotate(first, first + buf.rotation, buf.row_map.begin() + _margin_bottom + 1);
+  buf.rotation = 0;
+}
+
+// Rewrap the lines of buf, the main screen, from the current size to cols x
+// rows, for resize. Rows joined by their wrap flags form a line, which is
+// split again at the new width. If the rows no longer fit, the blank rows
+// below the cursor are dropped first, then rows from the top go to the
+// scrollback.
+void GridScreen::reflow(Buffer &buf, unsigned int cols, unsigned int rows) {
+  std::vector<char32_t> line_chars;
+  std::vector<attr_id> line_attrs;
+  std::vector<size_t> starts;
+  // the new rows, cols cells each
+  std::vector<char32_t> chars;
+  std::vector<attr_id> attrs;
+  std::vector<uint8_t> wrapped;
+  size_t cursor_row = 0;
+  size_t cursor_col = 0;
+
+  for (unsigned int y = 0; y < _rows;) {
+    line_chars.clear();
+    line_attrs.clear();
+    size_t cursor = SIZE_MAX;
+    bool more;
+    do {
+      unsigned int row = buf.row_map[y];
+      if (y == buf.saved_y) {
+        cursor = line_chars.size() + std::min(buf.saved_x, _cols);
+      }
+      if (buf.row_gen[row] == buf.gen) {
+        auto first = row * _cols;
+        // the last column of a row is left empty when a wide character
+        // wraps from it, and is not part of the line
+        if (_cols > 1
+            && !line_chars.empty()
+            && line_chars.back() == EMPTY_CELL
+            && buf.chars[first + 1] == WIDE_TAIL_CELL) {
+          line_chars.pop_back();
+          line_attrs.pop_back();
+          if (cursor != SIZE_MAX && cursor > line_chars.size()) {
+            --cursor;
+          }
+        }
+        line_chars.insert(
+            line_chars.end(),
+            buf.chars.begin() + first,
+            buf.chars.begin() + first + _cols);
+        line_attrs.insert(
+            line_attrs.end(),
+            buf.attrs.begin() + first,
+            buf.attrs.begin() + first + _cols);
+        more = buf.wrapped[row];
+      } else {
+        line_chars.insert(line_chars.end(), _cols, EMPTY_CELL);
+        line_attrs.insert(line_attrs.end(), _cols, buf.blank_id);
+        more = false;
+      }
+      ++y;
+    } while (more && y < _rows);
+
+    // trailing empty cells are dropped, except up to the cursor; the cells
+    // filling the last row take the attributes of the line's end, so lines
+    // with a background color keep it
+    attr_id fill = line_attrs.back();
+    size_t len = line_chars.size();
+    while (len > 0 && line_chars[len - 1] == EMPTY_CELL) {
+      --len;
+    }
+    if (cursor != SIZE_MAX) {
+      len = std::max(len, cursor + 1);
+    }
+    line_chars.resize(len, EMPTY_CELL);
+    line_attrs.resize(len, fill);
+
+    wrap_line(line_chars.data(), len, cols, starts);
+    size_t first_row = wrapped.size();
+    for (size_t k = 0; k < starts.size(); ++k) {
+      size_t begin = starts[k];
+      size_t end = k + 1 < starts.size() ? starts[k + 1] : len;
+      size_t pos = chars.size();
+      chars.insert(chars.end(), line_chars.begin() + begin, line_chars.begin() + end);
+      chars.insert(chars.end(), cols - (end - begin), EMPTY_CELL);
+      attrs.insert(attrs.end(), line_attrs.begin() + begin, line_attrs.begin() + end);
+      attrs.insert(attrs.end(), cols - (end - begin), fill);
+      // the right half of a wide character split on a single column
+      // screen
+      if (chars[pos] == WIDE_TAIL_CELL) {
+        chars[pos] = EMPTY_CELL;
+      }
+      wrapped.push_back(k + 1 < starts.size());
+    }
+    if (cursor != SIZE_MAX) {
+      size_t k = std::upper_bound(starts.begin(), starts.end(), cursor) - starts.begin() - 1;
+      cursor_row = first_row + k;
+      cursor_col = cursor - starts[k];
+    }
+  }
+
+  size_t num = wrapped.size();
+  while (num > rows
+      && num - 1 > cursor_row
+      && std::all_of(
+          chars.begin() + (num - 1) * cols,
+          chars.begin() + num * cols,
+          [](char32_t cell) { return cell == EMPTY_CELL; })) {
+    --num;
+  }
+  size_t top = std::min(num > rows ? num - rows : 0, cursor_row);
+  if (_scrollback) {
+    for (size_t k = 0; k < top; ++k) {
+      _scrollback->push(
+          &chars[k * cols],
+          &attrs[k * cols],
+          cols,
+          _attr_table,
+          _cluster_table,
+          wrapped[k]);
+    }
+  }
+
+  size_t shown = std::min(num - top, size_t(rows));
+  buf.chars.assign(cols * rows, EMPTY_CELL);
+  buf.attrs.assign(cols * rows, _def_id);
+  buf.wrapped.assign(rows, 0);
+  std::copy_n(&chars[top * cols], shown * cols, buf.chars.begin());
+  std::copy_n(&attrs[top * cols], shown * cols, buf.attrs.begin());
+  std::copy_n(&wrapped[top], shown, buf.wrapped.begin());
+  buf.row_map.resize(rows);
+  for (unsigned int y = 0; y < rows; ++y) {
+    buf.row_map[y] = y;
+  }
+  buf.row_gen.assign(rows, buf.gen);
+  buf.saved_x = cursor_col;
+  buf.saved_y = cursor_row - top;
+}
+
+// Cut or pad buf, the alternate screen, from the current size to cols x
+// rows, for resize. Cells are kept where they are; applications using the
+// alternate screen redraw it on a resize.
+void GridScreen::crop(Buffer &buf, unsigned int cols, unsigned int rows) {
+  std::vector<char32_t> chars(cols * rows, EMPTY_CELL);
+  std::vector<attr_id> attrs(cols * rows, _def_id);
+  unsigned int width = std::min(cols, _cols);
+  for (unsigned int y = 0; y < std::min(rows, _rows); ++y) {
+    unsigned int row = buf.row_map[y];
+    if (buf.row_gen[row] != buf.gen) {
+      std::fill_n(&attrs[y * cols], cols, buf.blank_id);
+      continue;
+    }
+    std::copy_n(&buf.chars[row * _cols], width, &chars[y * cols]);
+    std::copy_n(&buf.attrs[row * _cols], width, &attrs[y * cols]);
+    // a wide character cut in half by the new edge is dropped
+    if (width < _cols && buf.chars[row * _cols + width] == WIDE_TAIL_CELL) {
+      chars[y * cols + width - 1] = EMPTY_CELL;
+    }
+  }
+  buf.chars.swap(chars);
+  buf.attrs.swap(attrs);
+  buf.wrapped.assign(rows, 0);
+  buf.row_map.resize(rows);
+  for (unsigned int y = 0; y < rows; ++y) {
+    buf.row_map[y] = y;
+  }
+  buf.row_gen.assign(rows, buf.gen);
+  buf.saved_x = std::min(buf.saved_x, cols - 1);
+  buf.saved_y = std::min(buf.saved_y, rows - 1);
+}
+
+// Swap the main and alternate screens. The cursor stays where it is; the
+// caller restores it when coming back to the main screen.
+void GridScreen::switch_buffer() {
+  _buf.saved_x = _cursor_x;
+  _buf.saved_y = _cursor_y;
+  std::swap(_buf, _other);
+  damage_all();
+}
+
+// Clear a storage row left over from an erased generation
+void GridScreen::clear_row(unsigned int row) const {
+  std::fill_n(&_buf.chars[row * _cols], _cols, EMPTY_CELL);
+  std::fill_n(&_buf.attrs[row * _cols], _cols, _buf.blank_id);
+  _buf.wrapped[row] = false;
+  _buf.row_gen[row] = _buf.gen;
+}
+
+// Pull a pending wrap back onto the last column
+void GridScreen::clamp_cursor() {
+  if (_cursor_x >= _cols) {
+    _cursor_x = _cols - 1;
+  }
+}
+
+void GridScreen::damage(unsigned int y, unsigned int begin, unsigned int end) {
+  if (_shared) {
+    _unpublished[y] = true;
+  }
+  unsigned int row = storage_row(y);
+  if (_damage_begin[row] == _damage_end[row]) {
+    _damage_begin[row] = begin;
+    _damage_end[row] = end;
+  } else {
+    _damage_begin[row] = std::min(_damage_begin[row], begin);
+    _damage_end[row] = std::max(_damage_end[row], end);
+  }
+}
+
+void GridScreen::damage_all() {
+  std::fill(_damage_begin.begin(), _damage_begin.end(), 0);
+  std::fill(_damage_end.begin(), _damage_end.end(), _cols);
+  if (_shared) {
+    _unpublished.assign(_rows, true);
+  }
+}
+
+// Record a move of rows. Consecutive moves within the same range add up,
+// so a burst of output scrolling the screen reports a single shift.
+void GridScreen::damage_scroll(unsigned int top, unsigned int bottom, int delta) {
+  if (_shared) {
+    std::fill(_unpublished.begin() + top, _unpublished.begin() + bottom + 1, true);
+  }
+  if (!_scroll_damage.empty()) {
+    ScrollDamage &last = _scroll_damage.back();
+    if (last.top == top && last.bottom == bottom) {
+      last.delta += delta;
+      if (last.delta == 0) {
+        _scroll_damage.pop_back();
+      } else if (unsigned(std::abs(last.delta)) > bottom - top) {
+        // everything in the range was replaced
+        _scroll_damage.pop_back();
+        for (unsigned int y = top; y <= bottom; ++y) {
+          damage(y, 0, _cols);
+        }
+      }
+      return;
+    }
+  }
+  _scroll_damage.push_back(ScrollDamage{top, bottom, delta});
+}
+
+} // namespace screen
+} // namespace vtutils
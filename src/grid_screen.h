@@ -0,0 +1,357 @@
+#ifndef VTUTILS_GRID_SCREEN_H_
+#define VTUTILS_GRID_SCREEN_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "attr_table.h"
+#include "cluster_table.h"
+#include "screen.h"
+
+namespace vtutils {
+namespace screen {
+
+class Scrollback;
+
+// Contents of a cell that was never written to (or was erased)
+static const char32_t EMPTY_CELL = 0;
+// Contents of the right half of a wide character; the character itself is
+// in the cell to the left. Just past the last code point. Overwriting or
+// erasing either half of a wide character erases all of it.
+static const char32_t WIDE_TAIL_CELL = 0x110000;
+// Cells holding a grapheme cluster of more than one code point (a character
+// with combining marks, an emoji sequence) have this bit set, and the ID of
+// the cluster in the screen's ClusterTable in the other bits
+static const char32_t CLUSTER_CELL = 0x80000000;
+
+// Split a line of num cells into rows of at most width cells, as the
+// screen wraps text: a wide character that does not fit at the end of a
+// row starts the next one. Sets starts to the index of the first cell of
+// each row; an empty line is a single empty row.
+void wrap_line(
+    const char32_t *chars,
+    size_t num,
+    unsigned int width,
+    std::vector<size_t> &starts);
+
+// Rows top to bottom (inclusive) moved by delta rows, down if positive.
+// Rows moved in from outside the range are reported as damaged.
+struct ScrollDamage {
+  unsigned int top;
+  unsigned int bottom;
+  int delta;
+};
+
+// Cells begin to end (exclusive) of row changed
+struct RowDamage {
+  unsigned int row;
+  unsigned int begin;
+  unsigned int end;
+};
+
+// What changed on a GridScreen between two calls to collect_damage. To
+// bring a copy of the screen up to date, apply the scrolls in order, then
+// redraw the damaged rows.
+struct Damage {
+  std::vector<ScrollDamage> scrolls;
+  std::vector<RowDamage> rows;
+
+  bool empty() const { return scrolls.empty() && rows.empty(); }
+};
+
+// A copy of the contents of a GridScreen, taken by read_snapshot
+struct GridSnapshot {
+  unsigned int cols = 0;
+  unsigned int rows = 0;
+  unsigned int cursor_x = 0;
+  unsigned int cursor_y = 0;
+  // counts the snapshots published; equal generations hold equal contents
+  uint64_t generation = 0;
+  // cols * rows each, row-major. Clusters are represented by their first
+  // code point.
+  std::vector<char32_t> chars;
+  std::vector<Attr> attrs;
+
+  // Row y as utf-8, as GridScreen::line
+  std::string line(unsigned int y) const;
+};
+
+// A Screen that keeps the full terminal state in memory, without any I/O.
+// Cells are stored as two dense arrays, of code points and of attribute IDs
+// into an AttrTable, so a 200x60 screen takes ~70KB and stays in L2 while
+// being parsed into. The drawing methods are final, so a BasicVte<GridScreen>
+// calls them directly.
+//
+// Except for read_snapshot, a GridScreen belongs to the thread that feeds
+// its Vte.
+class GridScreen : public Screen {
+public:
+  GridScreen(unsigned int cols, unsigned int rows);
+  virtual ~GridScreen() = default;
+
+  void reset() final;
+  void hard_reset() final;
+
+  void set_flags(unsigned int flags) final;
+  void reset_flags(unsigned int flags) final;
+
+  void print(char32_t sym, Attr *attr) final;
+  void print_run(const char32_t *syms, size_t num, const Attr &attr) final;
+  void print_cluster(const char32_t *syms, size_t num, const Attr &attr) final;
+  void newline() final;
+  void insert_lines(unsigned int num) final;
+  void delete_lines(unsigned int num) final;
+  void insert_chars(unsigned int num) final;
+  void delete_chars(unsigned int num) final;
+  void alert() final;
+
+  Attr default_attr() final;
+  void set_def_attr(Attr attr) final;
+
+  void move_left(unsigned int num) final;
+  void move_right(unsigned int num) final;
+  void move_up(unsigned int num, bool scroll) final;
+  void move_down(unsigned int num, bool scroll) final;
+  void move_to(unsigned int x, unsigned int y) final;
+  void move_line_home() final;
+
+  void scroll_up(unsigned int num) final;
+  void scroll_down(unsigned int num) final;
+
+  void set_tabstop() final;
+  void reset_tabstop() final;
+  void reset_all_tabstops() final;
+  void tab_right(unsigned int num) final;
+  void tab_left(unsigned int num) final;
+
+  unsigned int get_cursor_x() final;
+  unsigned int get_cursor_y() final;
+
+  void erase_screen(bool protect) final;
+  void erase_cursor_to_screen(bool protect) final;
+  void erase_screen_to_cursor(bool protect) final;
+  void erase_cursor_to_end(bool protect) final;
+  void erase_home_to_cursor(bool protect) final;
+  void erase_current_line(bool protect) final;
+  void erase_chars(unsigned int num) final;
+
+  void set_margins(unsigned int top, unsigned int bottom) final;
+  void resize(unsigned int cols, unsigned int rows) override;
+  // each buffer keeps its own cursor
+  bool keeps_alternate_cursor() const final { return true; }
+
+  void write(char sym) final;
+  void write(const char *data, size_t len) final;
+
+  // publishes a snapshot, if enabled
+  void flush() final;
+
+  //
+  // Read access to the screen state
+  //
+
+  unsigned int cols() const { return _cols; }
+  unsigned int rows() const { return _rows; }
+  unsigned int cursor_x() const { return _cursor_x; }
+  unsigned int cursor_y() const { return _cursor_y; }
+  unsigned int flags() const { return _flags; }
+  unsigned int bell_count() const { return _bell_count; }
+
+  // The code points and attribute IDs of row y, of the buffer in use;
+  // cols() entries each
+  const char32_t* row_chars(unsigned int y) const {
+    return &_buf.chars[row_start(y)];
+  }
+  const attr_id* row_attrs(unsigned int y) const {
+    return &_buf.attrs[row_start(y)];
+  }
+  // Whether row y ends with an automatic wrap, its line going on in row
+  // y + 1
+  bool row_wrapped(unsigned int y) const {
+    row_start(y);
+    return _buf.wrapped[storage_row(y)];
+  }
+  // The attributes for an ID taken from row_attrs
+  const Attr& attr(attr_id id) const {
+    return _attr_table[id];
+  }
+  // The code points of a cell taken from row_chars: its cluster, or the
+  // cell itself
+  std::u32string_view cell_text(const char32_t &cell) const {
+    if (cell & CLUSTER_CELL) {
+      return _cluster_table[cell & ~CLUSTER_CELL];
+    }
+    return std::u32string_view(&cell, 1);
+  }
+
+  // Row y as utf-8, with empty cells as spaces and trailing empty cells
+  // dropped
+  std::string line(unsigned int y) const;
+
+  // The damage since the last call, or since the screen was created, in
+  // which case all of it is damaged. The damage is cleared.
+  Damage collect_damage();
+
+  // Start publishing snapshots for read_snapshot, at the end of each input
+  // batch
+  void enable_snapshots();
+  // Publish a snapshot now, rather than at the end of the input batch.
+  // Copies only the rows changed since the last publish, under a sequence
+  // lock, and never waits for readers.
+  void publish();
+  // Copy the last published snapshot. Safe to call from any thread, once
+  // enable_snapshots has returned; never blocks the writer, and retries if
+  // a publish overlapped the copy. Returns false if snapshots are disabled.
+  bool read_snapshot(GridSnapshot &snapshot) const;
+
+  // Lines scrolled off the top of the screen are added to scrollback, if
+  // set. The scrollback is not owned by the screen.
+  void set_scrollback(Scrollback *scrollback) { _scrollback = scrollback; }
+  Scrollback* scrollback() const { return _scrollback; }
+
+  // Everything written to the application (replies to DA, DSR, ...) since
+  // the last call to take_output
+  std::string take_output();
+
+private:
+  unsigned int _cols;
+  unsigned int _rows;
+
+  // The main and alternate screens are two preallocated buffers, and
+  // switching between them swaps _buf and _other.
+  struct Buffer {
+    // cell contents, _cols * _rows each, by storage row
+    std::vector<char32_t> chars;
+    std::vector<attr_id> attrs;
+    // storage row of each screen row. Within the scroll region, screen row
+    // y is at row_map[_margin_top + (y - _margin_top + rotation) % height].
+    std::vector<unsigned int> row_map;
+    unsigned int rotation = 0;
+    // set on the storage rows the cursor wrapped off
+    std::vector<uint8_t> wrapped;
+    // Storage rows whose generation is behind the buffer's were erased,
+    // with blank_id as their attributes, and are cleared when next touched;
+    // erasing the whole screen only bumps gen
+    std::vector<uint32_t> row_gen;
+    uint32_t gen = 0;
+    attr_id blank_id = DEFAULT_ATTR_ID;
+    // the cursor when the buffer was last left, restored on switching back
+    unsigned int saved_x = 0;
+    unsigned int saved_y = 0;
+  };
+  // the buffer in use, and the other one. Rows are cleared lazily from
+  // const accessors, hence mutable.
+  mutable Buffer _buf;
+  Buffer _other;
+
+  // interned attributes; the last used entry is cached, so runs of text
+  // with the same attributes skip the lookup
+  AttrTable _attr_table;
+  Attr _last_attr;
+  attr_id _last_id;
+  // the table is garbage collected when it grows past this size
+  size_t _gc_threshold;
+  // interned clusters, collected like the attributes
+  ClusterTable _cluster_table;
+  size_t _cluster_gc_threshold;
+
+  unsigned int _flags;
+  // cursor position. _cursor_x may be one past the last column, after a
+  // character was printed there; the wrap happens on the next print.
+  unsigned int _cursor_x;
+  unsigned int _cursor_y;
+  // scroll region, inclusive
+  unsigned int _margin_top;
+  unsigned int _margin_bottom;
+  std::vector<bool> _tabs;
+  Attr _def_attr;
+  attr_id _def_id;
+  unsigned int _bell_count = 0;
+  std::string _output;
+  Scrollback *_scrollback = nullptr;
+
+  // damaged columns of each storage row, begin to end; clean rows have
+  // begin == end. The damage moves with the rows when they scroll.
+  std::vector<unsigned int> _damage_begin;
+  std::vector<unsigned int> _damage_end;
+  std::vector<ScrollDamage> _scroll_damage;
+
+  // Published snapshot, shared with the reader threads. Everything readers
+  // copy is atomic, so copies racing a publish are well defined; seq is odd
+  // while a publish is in progress.
+  struct Shared {
+    struct Cells {
+      size_t capacity;
+      std::unique_ptr<std::atomic<char32_t>[]> chars;
+      // packed with pack_attr
+      std::unique_ptr<std::atomic<uint64_t>[]> attrs;
+    };
+    // The cells in use, the last of all_cells. When the screen outgrows
+    // them they are replaced by twice as many, but the old ones are kept
+    // until the screen is destroyed, as readers may still be copying them.
+    std::atomic<Cells*> cells{nullptr};
+    std::vector<std::unique_ptr<Cells>> all_cells;
+    std::atomic<unsigned int> cols{0};
+    std::atomic<unsigned int> rows{0};
+    std::atomic<unsigned int> cursor_x{0};
+    std::atomic<unsigned int> cursor_y{0};
+    std::atomic<uint64_t> seq{0};
+  };
+  std::unique_ptr<Shared> _shared;
+  // rows changed since the last publish
+  std::vector<bool> _unpublished;
+
+  attr_id intern(const Attr &attr);
+  void collect_attrs();
+  bool intern_cluster(const char32_t *syms, size_t num, cluster_id &id);
+  void collect_clusters();
+  void put(char32_t sym, attr_id id);
+  void put_cluster(const char32_t *syms, size_t num, attr_id id);
+  void put_cell(char32_t cell, unsigned int width, attr_id id);
+  void combine(const char32_t *syms, size_t num);
+  char32_t *cell_before_cursor(unsigned int &x);
+  bool extends_previous(char32_t sym);
+  void clear_cells(unsigned int from, unsigned int to, bool protect);
+  void rotate_lines(unsigned int top, unsigned int bottom, int delta);
+  void unrotate(Buffer &buf);
+  void reflow(Buffer &buf, unsigned int cols, unsigned int rows);
+  void crop(Buffer &buf, unsigned int cols, unsigned int rows);
+  void split_wide(unsigned int y, unsigned int x);
+  void clamp_cursor();
+  void switch_buffer();
+  // The storage row of screen row y. Scrolling moves row handles rather
+  // than cells: the handles of the scroll region form a ring, and scrolling
+  // the whole region only turns it, clearing the rows scrolled in, so it
+  // costs the same whatever the height of the region.
+  unsigned int storage_row(unsigned int y) const {
+    if (_buf.rotation && y >= _margin_top && y <= _margin_bottom) {
+      y += _buf.rotation;
+      if (y > _margin_bottom) {
+        y -= _margin_bottom - _margin_top + 1;
+      }
+    }
+    return _buf.row_map[y];
+  }
+  // The index of the first cell of screen row y, clearing the row first if
+  // it was erased
+  unsigned int row_start(unsigned int y) const {
+    unsigned int row = storage_row(y);
+    if (_buf.row_gen[row] != _buf.gen) {
+      clear_row(row);
+    }
+    return row * _cols;
+  }
+  void clear_row(unsigned int row) const;
+  void damage(unsigned int y, unsigned int begin, unsigned int end);
+  void damage_all();
+  void damage_scroll(unsigned int top, unsigned int bottom, int delta);
+};
+
+} // namespace screen
+} // namespace vtutils
+
+#endif /* VTUTILS_GRID_SCREEN_H_ */
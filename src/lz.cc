@@ -0,0 +1,165 @@
+#include "lz.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace vtutils {
+namespace lz {
+
+// Block format (as LZ4): a sequence of
+//   token       high nibble: literal count, low nibble: match length - 4
+//   [length]    extra literal count bytes, if the nibble is 15
+//   literals
+//   offset      2 bytes, little endian
+//   [length]    extra match length bytes, if the nibble is 15
+// The last sequence has literals only. Lengths continue with bytes of 255
+// up to a final byte below 255.
+
+static const size_t MIN_MATCH = 4;
+// the last match must start this far from the end of the input...
+static const size_t MATCH_LIMIT = 12;
+// ...and end this far from it
+static const size_t LAST_LITERALS = 5;
+static const size_t MAX_OFFSET = 0xffff;
+static const int HASH_BITS = 12;
+
+static uint32_t read32(const char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t hash(uint32_t seq) {
+  return (seq * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static void put_length(size_t len, std::string &out) {
+  while (len >= 255) {
+    out.push_back((char) 255);
+    len -= 255;
+  }
+  out.push_back((char) len);
+}
+
+static void put_sequence(
+    const char *lit, size_t lit_len, size_t offset, size_t match_len, std::string &out) {
+  size_t token_pos = out.size();
+  unsigned int token = (lit_len < 15 ? lit_len : 15) << 4;
+  out.push_back(0);
+  if (lit_len >= 15) {
+    put_length(lit_len - 15, out);
+  }
+  out.append(lit, lit_len);
+
+  if (match_len > 0) {
+    out.push_back((char) (offset & 0xff));
+    out.push_back((char) (offset >> 8));
+    match_len -= MIN_MATCH;
+    token |= match_len < 15 ? match_len : 15;
+    if (match_len >= 15) {
+      put_length(match_len - 15, out);
+    }
+  }
+  out[token_pos] = (char) token;
+}
+
+void compress(const char *in, size_t len, std::string &out) {
+  // positions are stored plus one, so 0 means empty
+  std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+  size_t anchor = 0;
+  size_t pos = 0;
+
+  if (len > MATCH_LIMIT) {
+    size_t limit = len - MATCH_LIMIT;
+    while (pos < limit) {
+      uint32_t seq = read32(in + pos);
+      uint32_t &slot = table[hash(seq)];
+      size_t ref = slot;
+      slot = pos + 1;
+      if (ref == 0 || pos - (ref - 1) > MAX_OFFSET || read32(in + ref - 1) != seq) {
+        ++pos;
+        continue;
+      }
+      --ref;
+
+      size_t match_len = MIN_MATCH;
+      size_t max_len = len - LAST_LITERALS - pos;
+      while (match_len < max_len && in[ref + match_len] == in[pos + match_len]) {
+        ++match_len;
+      }
+      put_sequence(in + anchor, pos - anchor, pos - ref, match_len, out);
+      pos += match_len;
+      anchor = pos;
+    }
+  }
+  put_sequence(in + anchor, len - anchor, 0, 0, out);
+}
+
+// Reads a length continuation. Returns false if it runs past end.
+static bool get_length(const uint8_t *&p, const uint8_t *end, size_t &len) {
+  uint8_t b;
+  do {
+    if (p == end) {
+      return false;
+    }
+    b = *p++;
+    len += b;
+  } while (b == 255);
+  return true;
+}
+
+bool decompress(const char *in, size_t len, char *out, size_t out_len) {
+  const uint8_t *p = (const uint8_t *) in;
+  const uint8_t *end = p + len;
+  size_t pos = 0;
+
+  while (p < end) {
+    unsigned int token = *p++;
+
+    size_t lit_len = token >> 4;
+    if (lit_len == 15 && !get_length(p, end, lit_len)) {
+      return false;
+    }
+    if (lit_len > size_t(end - p) || lit_len > out_len - pos) {
+      return false;
+    }
+    memcpy(out + pos, p, lit_len);
+    p += lit_len;
+    pos += lit_len;
+
+    if (p == end) {
+      // the last sequence has no match
+      break;
+    }
+
+    if (end - p < 2) {
+      return false;
+    }
+    size_t offset = p[0] | (p[1] << 8);
+    p += 2;
+    size_t match_len = token & 0x0f;
+    if (match_len == 15 && !get_length(p, end, match_len)) {
+      return false;
+    }
+    match_len += MIN_MATCH;
+    if (offset == 0 || offset > pos || match_len > out_len - pos) {
+      return false;
+    }
+    // matches may overlap their own output, so copy forwards byte by byte
+    // unless they don't
+    const char *src = out + pos - offset;
+    if (offset >= match_len) {
+      memcpy(out + pos, src, match_len);
+    } else {
+      for (size_t i = 0; i < match_len; ++i) {
+        out[pos + i] = src[i];
+      }
+    }
+    pos += match_len;
+  }
+  return pos == out_len;
+}
+
+} // namespace lz
+} // namespace vtutils
@@ -0,0 +1,25 @@
+#ifndef VTUTILS_LZ_H_
+#define VTUTILS_LZ_H_
+
+#include <cstddef>
+#include <string>
+
+// A small LZ77 codec producing the LZ4 block format. It favors speed over
+// ratio: one hash probe per position, no lazy matching. Terminal history is
+// repetitive enough (prompts, indentation, attribute runs) that this still
+// compresses it several times over.
+namespace vtutils {
+namespace lz {
+
+// Compress len bytes from in, appending the result to out
+void compress(const char *in, size_t len, std::string &out);
+
+// Decompress a block produced by compress into out, which must have room
+// for exactly out_len bytes, the size of the original data. Returns false
+// if the block is malformed or does not decompress to out_len bytes.
+bool decompress(const char *in, size_t len, char *out, size_t out_len);
+
+} // namespace lz
+} // namespace vtutils
+
+#endif /* VTUTILS_LZ_H_ */
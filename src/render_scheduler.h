@@ -0,0 +1,149 @@
+#ifndef VTUTILS_RENDER_SCHEDULER_H_
+#define VTUTILS_RENDER_SCHEDULER_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+
+namespace vtutils {
+namespace vte {
+
+// Decouples parsing from drawing.
+//
+// The Vte parses into an in-memory model (a GridScreen, say) as fast as it
+// can, and the scheduler decides when the model is drawn, by calling the
+// render callback (which might present a BoxScreen, or draw the damage of a
+// GridScreen). A frame is rendered once output goes idle for the idle
+// timeout, or once changes have waited a whole frame interval, whichever
+// comes first; frames are never closer together than the frame interval.
+// So a lone keystroke echo is drawn almost at once, and a flood of output
+// is drawn at the frame rate however fast it is parsed.
+//
+// Parsing is time sliced: feed() returns after the slice, even if it did
+// not consume all of its input, so the driving loop can attend to keyboard
+// input between slices. Input left over is the back-pressure signal: stop
+// reading from the application until it has been fed, and the kernel will
+// hold the application back.
+//
+// A typical loop:
+//
+//   while (...) {
+//     poll fds with a timeout of scheduler.poll()
+//     handle keyboard input
+//     if (backlog is empty) read the application's output into backlog
+//     consume scheduler.feed(backlog) from backlog
+//   }
+//
+// ClockT is only replaced by the tests, to run the scheduler on made up
+// time.
+template <class VteT, class ClockT = std::chrono::steady_clock>
+class RenderScheduler {
+public:
+  typedef ClockT Clock;
+  typedef typename Clock::duration duration;
+  typedef typename Clock::time_point time_point;
+
+  // largest span handed to the Vte at once; the clock is checked in between
+  static constexpr size_t CHUNK_SIZE = 4096;
+
+  RenderScheduler(VteT &vte, std::function<void()> render)
+      : _vte(vte), _render(render) {}
+
+  // Shortest time between frames; 60 Hz by default
+  void set_frame_interval(duration interval) {
+    _frame_interval = interval;
+  }
+  // Quiet time after which output is drawn without waiting for the frame
+  // interval
+  void set_idle_timeout(duration timeout) {
+    _idle_timeout = timeout;
+  }
+  // Longest time feed parses before returning
+  void set_slice(duration slice) {
+    _slice = slice;
+  }
+
+  // Parse data for at most a time slice, rendering any frame that falls
+  // due. Returns the number of bytes consumed.
+  size_t feed(const char *data, size_t len) {
+    time_point start = Clock::now();
+    time_point now = start;
+    size_t done = 0;
+    while (done < len) {
+      size_t chunk = std::min(len - done, CHUNK_SIZE);
+      _vte.input(data + done, chunk);
+      done += chunk;
+
+      now = Clock::now();
+      if (!_dirty) {
+        _dirty = true;
+        _dirty_since = now;
+      }
+      _last_input = now;
+      if (now >= due()) {
+        render(now);
+      }
+      if (now - start >= _slice) {
+        break;
+      }
+    }
+    return done;
+  }
+
+  // Render the frame if it is due. Returns the time until the next frame
+  // would be due, to be used as a poll timeout, or duration::max()
+  // if nothing is waiting to be drawn.
+  duration poll() {
+    if (!_dirty) {
+      return duration::max();
+    }
+    time_point now = Clock::now();
+    if (now >= due()) {
+      render(now);
+      return duration::max();
+    }
+    return due() - now;
+  }
+
+  // true if there are changes not yet rendered
+  bool pending() const {
+    return _dirty;
+  }
+
+  // Render straight away, e.g. after a resize
+  void render_now() {
+    render(Clock::now());
+  }
+
+private:
+  VteT &_vte;
+  std::function<void()> _render;
+  duration _frame_interval = std::chrono::microseconds(16667);
+  duration _idle_timeout = std::chrono::milliseconds(4);
+  duration _slice = std::chrono::milliseconds(5);
+
+  bool _dirty = false;
+  // first unrendered change, and latest input
+  time_point _dirty_since;
+  time_point _last_input;
+  time_point _last_render;
+
+  time_point due() const {
+    time_point ready = std::min(
+        _last_input + _idle_timeout,
+        _dirty_since + _frame_interval);
+    return std::max(ready, _last_render + _frame_interval);
+  }
+
+  void render(time_point now) {
+    _render();
+    _dirty = false;
+    _last_render = now;
+  }
+};
+
+} // namespace vte
+} // namespace vtutils
+
+#endif /* VTUTILS_RENDER_SCHEDULER_H_ */
@@ -35,5 +35,54 @@ std::ostream& operator<<(std::ostream &out, const Attr &attr) {
   return out;
 }
 
+void Screen::print_run(const char32_t *syms, size_t num, const Attr &attr) {
+  Attr run_attr = attr;
+  for (size_t i = 0; i < num; ++i) {
+    print(syms[i], &run_attr);
+  }
+}
+
+void Screen::print_cluster(const char32_t *syms, size_t num, const Attr &attr) {
+  print_run(syms, num, attr);
+}
+
+void Screen::write(const char *data, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    write(data[i]);
+  }
+}
+
+void Screen::resize(unsigned int cols, unsigned int rows) {
+  // ignored by default
+}
+
+bool Screen::keeps_alternate_cursor() const {
+  return false;
+}
+
+void Screen::osc(int command, std::string_view data) {
+  // ignored by default
+}
+
+void Screen::dcs_start(
+    char32_t final,
+    std::string_view intermediates,
+    const int *params,
+    unsigned int num_params) {
+  // ignored by default
+}
+
+void Screen::dcs_data(std::string_view data) {
+  // ignored by default
+}
+
+void Screen::dcs_end(bool aborted) {
+  // ignored by default
+}
+
+void Screen::flush() {
+  // ignored by default
+}
+
 } // namespace screen
 } // namespace vtutils
@@ -1,7 +1,10 @@
 #ifndef VTUTILS_SCREEN_H_
 #define VTUTILS_SCREEN_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <ostream>
+#include <string_view>
 
 // A Screen abstraction for the terminal emulation library.
 namespace vtutils {
@@ -54,6 +57,30 @@ struct Attr {
   bool blink : 1;
 };
 
+// Colors are equal if they have the same code. RGB values are only compared
+// for RGB colors; they are left over from earlier colors otherwise.
+inline bool operator==(const Color &a, const Color &b) {
+  return a.color_code == b.color_code
+      && (a.color_code != COLOR_CODE_RGB
+          || (a.r == b.r && a.g == b.g && a.b == b.b));
+}
+inline bool operator!=(const Color &a, const Color &b) {
+  return !(a == b);
+}
+
+inline bool operator==(const Attr &a, const Attr &b) {
+  return a.fg == b.fg
+      && a.bg == b.bg
+      && a.bold == b.bold
+      && a.underline == b.underline
+      && a.inverse == b.inverse
+      && a.protect == b.protect
+      && a.blink == b.blink;
+}
+inline bool operator!=(const Attr &a, const Attr &b) {
+  return !(a == b);
+}
+
 std::ostream& operator<<(std::ostream &out, const Color &color);
 std::ostream& operator<<(std::ostream &out, const Attr &attr);
 
@@ -71,6 +98,14 @@ class Screen {
   
   // print the character to the screen
   virtual void print(char32_t sym, Attr *attr) = 0;
+  // print a run of characters sharing the same attributes. Equivalent to
+  // calling print for each character, which is what the default does.
+  virtual void print_run(const char32_t *syms, size_t num, const Attr &attr);
+  // print a grapheme cluster: a base character and the code points that
+  // combine with it, taking up the cells of one character. A cluster
+  // starting with a combining code point continues the last character
+  // printed. The default prints each code point in turn.
+  virtual void print_cluster(const char32_t *syms, size_t num, const Attr &attr);
   
   virtual void newline() = 0;
   virtual void insert_lines(unsigned int num) = 0;
@@ -111,9 +146,48 @@ class Screen {
   virtual void erase_chars(unsigned int num) = 0;
   
   virtual void set_margins(unsigned int top, unsigned int bottom) = 0;
+
+  // The terminal is now cols x rows. The scroll region is reset to the
+  // whole screen and the cursor is kept on it. Ignored by default, for
+  // screens of a fixed size.
+  virtual void resize(unsigned int cols, unsigned int rows);
+
+  // Whether the screen saves the cursor on entering the alternate screen
+  // (SCREEN_ALTERNATE), and restores it on leaving. The Vte then leaves the
+  // cursor of mode 1049 to the screen. False by default.
+  virtual bool keeps_alternate_cursor() const;
   
   // push the character to the sub-processes std-in
   virtual void write(char sym) = 0;
+  // push a block of characters to the sub-processes std-in. Equivalent to
+  // calling write for each character, which is what the default does.
+  virtual void write(const char *data, size_t len);
+
+  // An OSC (operating system command) string was received, such as a window
+  // title (0, 1, 2), hyperlink (8) or clipboard data (52). command is the
+  // leading numeric parameter, or -1 if there was none; data is the rest of
+  // the string after the ';', and is only valid for the duration of the call.
+  virtual void osc(int command, std::string_view data);
+
+  // A DCS (device control string) was started. final is the character that
+  // ended the introducer, intermediates holds any intermediate or private
+  // marker characters, and params the numeric parameters (-1 where omitted).
+  virtual void dcs_start(
+      char32_t final,
+      std::string_view intermediates,
+      const int *params,
+      unsigned int num_params);
+  // The next chunk of the DCS payload. Payloads are streamed as they arrive
+  // and may be split anywhere; data is only valid for the duration of the
+  // call, and usually points straight into the buffer given to the Vte.
+  virtual void dcs_data(std::string_view data);
+  // The DCS string ended. aborted is set if it was cancelled by CAN or SUB
+  // rather than ended by ST.
+  virtual void dcs_end(bool aborted);
+
+  // The Vte finished passing a batch of input to the screen. Screens that
+  // buffer their drawing should make it visible here. Ignored by default.
+  virtual void flush();
 };
 
 } // namespace screen
@@ -0,0 +1,564 @@
+#include "scrollback.h"
+
+#include <algorithm>
+
+#include "grid_screen.h"
+#include "lz.h"
+#include "unicode.h"
+
+namespace vtutils {
+namespace screen {
+
+const size_t Scrollback::BLOCK_LINES;
+const size_t Scrollback::HOT_BLOCKS;
+const size_t Scrollback::FILTER_GROUP_LINES;
+const size_t Scrollback::FILTER_BITS_PER_KEY;
+const size_t Scrollback::MAX_LINE_CELLS;
+
+// Serialized line:
+//   varint  number of cells * 2 + 1 if the line is wrapped
+//   varint  number of attribute runs
+//   varint  number of clusters
+//   varint  number of bytes of text
+//   runs    varint number of cells, then the attributes in ATTR_BYTES
+//   clusters  varint cell, then varint number of code points * 2 + 1 if
+//           the cluster is wide, for each cell holding a cluster
+//   text    utf-8, the code points of each cell in turn; empty cells are
+//           NUL, and the right halves of wide characters are left out
+
+static const size_t ATTR_BYTES = 9;
+
+static void put_varint(size_t v, std::string &out) {
+  while (v >= 0x80) {
+    out.push_back((char) (v | 0x80));
+    v >>= 7;
+  }
+  out.push_back((char) v);
+}
+
+static size_t get_varint(const char *&p) {
+  size_t v = 0;
+  for (int shift = 0;; shift += 7) {
+    uint8_t b = *p++;
+    v |= size_t(b & 0x7f) << shift;
+    if (b < 0x80) {
+      return v;
+    }
+  }
+}
+
+static void put_attr(const Attr &attr, std::string &out) {
+  char buf[ATTR_BYTES] = {
+    (char) attr.fg.color_code,
+    (char) attr.fg.r,
+    (char) attr.fg.g,
+    (char) attr.fg.b,
+    (char) attr.bg.color_code,
+    (char) attr.bg.r,
+    (char) attr.bg.g,
+    (char) attr.bg.b,
+    (char) (attr.bold
+        | attr.underline << 1
+        | attr.inverse << 2
+        | attr.protect << 3
+        | attr.blink << 4),
+  };
+  out.append(buf, ATTR_BYTES);
+}
+
+static Attr get_attr(const char *p) {
+  Attr attr{};
+  attr.fg.color_code = (ColorCode) p[0];
+  attr.fg.r = p[1];
+  attr.fg.g = p[2];
+  attr.fg.b = p[3];
+  attr.bg.color_code = (ColorCode) p[4];
+  attr.bg.r = p[5];
+  attr.bg.g = p[6];
+  attr.bg.b = p[7];
+  attr.bold = p[8] & 0x01;
+  attr.underline = p[8] & 0x02;
+  attr.inverse = p[8] & 0x04;
+  attr.protect = p[8] & 0x08;
+  attr.blink = p[8] & 0x10;
+  return attr;
+}
+
+// Skips over the serialized line at p, returning its end
+static const char* skip_line(const char *p) {
+  get_varint(p);
+  size_t runs = get_varint(p);
+  size_t clusters = get_varint(p);
+  size_t text_len = get_varint(p);
+  for (size_t i = 0; i < runs; ++i) {
+    get_varint(p);
+    p += ATTR_BYTES;
+  }
+  for (size_t i = 0; i < clusters; ++i) {
+    get_varint(p);
+    get_varint(p);
+  }
+  return p + text_len;
+}
+
+// Returns the text of a serialized line
+static std::string_view line_text(const char *p, size_t len) {
+  const char *end = p + len;
+  get_varint(p);
+  get_varint(p);
+  get_varint(p);
+  size_t text_len = get_varint(p);
+  return std::string_view(end - text_len, text_len);
+}
+
+static char fold(char c) {
+  return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// The text of a serialized line as searched: case folded, with empty cells
+// as spaces
+static void search_text(const char *p, size_t len, bool ignore_case, std::string &text) {
+  text = line_text(p, len);
+  for (char &c : text) {
+    c = c ? (ignore_case ? fold(c) : c) : ' ';
+  }
+}
+
+// The trigram starting at p, which must be folded, as a 24 bit key
+static uint32_t trigram(const char *p) {
+  return uint8_t(p[0]) | uint8_t(p[1]) << 8 | uint8_t(p[2]) << 16;
+}
+
+// The filter key of a trigram in a group of FILTER_GROUP_LINES lines
+static uint32_t filter_key(uint32_t trigram, size_t group) {
+  return trigram | uint32_t(group) << 24;
+}
+static_assert(
+    Scrollback::BLOCK_LINES / Scrollback::FILTER_GROUP_LINES <= 32,
+    "the groups of a block must fit a 32 bit mask");
+
+static const unsigned int FILTER_HASHES = 3;
+
+// The filter bit for hash i of a key, in a filter of bits bits
+static size_t filter_bit(uint32_t key, unsigned int i, size_t bits) {
+  uint64_t h = key * 0x9e3779b97f4a7c15ull;
+  h ^= h >> 29;
+  uint32_t hash = uint32_t(h >> 32) + i * (uint32_t(h) | 1);
+  return (uint64_t(hash) * bits) >> 32;
+}
+
+static bool filter_holds(const std::vector<uint64_t> &filter, uint32_t key) {
+  size_t bits = filter.size() * 64;
+  for (unsigned int i = 0; i < FILTER_HASHES; ++i) {
+    size_t bit = filter_bit(key, i, bits);
+    if (!(filter[bit / 64] & uint64_t(1) << (bit % 64))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Scrollback::Scrollback(size_t byte_budget)
+    : _byte_budget(byte_budget) {
+}
+
+void Scrollback::push(
+    const char32_t *chars,
+    const attr_id *attrs,
+    size_t num,
+    const AttrTable &table,
+    const ClusterTable &cluster_table,
+    bool wrapped) {
+  // the column a wide character wrapped from is not part of the line
+  if (_joining
+      && num > 1
+      && chars[1] == WIDE_TAIL_CELL
+      && !_line.chars.empty()
+      && _line.chars.back() == EMPTY_CELL) {
+    _line.chars.pop_back();
+    _line.attrs.pop_back();
+  }
+  _line.chars.reserve(_line.chars.size() + num);
+  _line.attrs.reserve(_line.attrs.size() + num);
+  for (size_t i = 0; i < num; ++i) {
+    char32_t cell = chars[i];
+    if (cell & CLUSTER_CELL) {
+      _line.clusters.emplace_back(cluster_table[cell & ~CLUSTER_CELL]);
+      cell = CLUSTER_CELL | (_line.clusters.size() - 1);
+    }
+    _line.chars.push_back(cell);
+    if (i > 0 && attrs[i] == attrs[i - 1]) {
+      _line.attrs.push_back(_line.attrs.back());
+    } else {
+      _line.attrs.push_back(table[attrs[i]]);
+    }
+  }
+  if (wrapped && _line.chars.size() < MAX_LINE_CELLS) {
+    _line.wrapped = true;
+    _joining = true;
+    return;
+  }
+
+  while (!_line.chars.empty()
+      && _line.chars.back() == EMPTY_CELL
+      && _line.attrs.back() == Attr{}) {
+    _line.chars.pop_back();
+    _line.attrs.pop_back();
+  }
+  _line.wrapped = wrapped;
+  store(_line);
+  _line.chars.clear();
+  _line.attrs.clear();
+  _line.clusters.clear();
+  _joining = false;
+}
+
+// Serialize a line into the newest block
+void Scrollback::store(const ScrollbackLine &line) {
+  if (_blocks.empty() || _blocks.back().lines == BLOCK_LINES) {
+    if (_blocks.size() >= HOT_BLOCKS) {
+      freeze(_blocks[_blocks.size() - HOT_BLOCKS]);
+    }
+    _blocks.emplace_back();
+    _blocks.back().serial = _next_serial++;
+  }
+  Block &block = _blocks.back();
+  size_t start = block.data.size();
+  block.offsets.push_back(start);
+
+  const std::vector<char32_t> &chars = line.chars;
+  const std::vector<Attr> &attrs = line.attrs;
+  size_t num = chars.size();
+  size_t runs = 0;
+  for (size_t i = 0; i < num; ++i) {
+    if (i == 0 || !(attrs[i] == attrs[i - 1])) {
+      ++runs;
+    }
+  }
+  std::string text;
+  std::string clusters;
+  size_t num_clusters = 0;
+  char u8[4];
+  for (size_t i = 0; i < num; ++i) {
+    // the right halves of wide characters are put back by get
+    if (chars[i] == WIDE_TAIL_CELL) {
+      continue;
+    }
+    if (chars[i] & CLUSTER_CELL) {
+      const std::u32string &cluster = line.clusters[chars[i] & ~CLUSTER_CELL];
+      bool wide = i + 1 < num && chars[i + 1] == WIDE_TAIL_CELL;
+      put_varint(i, clusters);
+      put_varint(cluster.size() * 2 + wide, clusters);
+      ++num_clusters;
+      for (char32_t sym : cluster) {
+        text.append(u8, unicode::Utf8To32Converter::reverse(u8, sym));
+      }
+    } else {
+      text.append(u8, unicode::Utf8To32Converter::reverse(u8, chars[i]));
+    }
+  }
+
+  put_varint(num * 2 + line.wrapped, block.data);
+  put_varint(runs, block.data);
+  put_varint(num_clusters, block.data);
+  put_varint(text.size(), block.data);
+  for (size_t i = 0; i < num;) {
+    size_t j = i + 1;
+    while (j < num && attrs[j] == attrs[i]) {
+      ++j;
+    }
+    put_varint(j - i, block.data);
+    put_attr(attrs[i], block.data);
+    i = j;
+  }
+  block.data += clusters;
+  block.data += text;
+
+  block.raw_size = block.data.size();
+  ++block.lines;
+  ++_size;
+  _bytes += block.data.size() - start + sizeof(uint32_t);
+  evict();
+}
+
+void Scrollback::set_byte_budget(size_t byte_budget) {
+  _byte_budget = byte_budget;
+  evict();
+}
+
+bool Scrollback::get(size_t n, ScrollbackLine &line) {
+  if (_joining && n == 0) {
+    line = _line;
+    return true;
+  }
+  const char *p;
+  size_t len;
+  if (!find(n - _joining, p, len)) {
+    return false;
+  }
+
+  size_t header = get_varint(p);
+  size_t cells = header / 2;
+  line.wrapped = header & 1;
+  size_t runs = get_varint(p);
+  size_t num_clusters = get_varint(p);
+  size_t text_len = get_varint(p);
+  line.attrs.clear();
+  line.attrs.reserve(cells);
+  for (size_t i = 0; i < runs; ++i) {
+    size_t run = get_varint(p);
+    line.attrs.insert(line.attrs.end(), run, get_attr(p));
+    p += ATTR_BYTES;
+  }
+  // cell and length * 2 + wide of each cluster
+  std::vector<std::pair<size_t, size_t>> clusters(num_clusters);
+  for (auto &cluster : clusters) {
+    cluster.first = get_varint(p);
+    cluster.second = get_varint(p);
+  }
+
+  // the text was encoded from whole code points, so it decodes to exactly
+  // those of the cells
+  unicode::Utf8To32Converter converter;
+  std::vector<char32_t> syms(text_len);
+  syms.resize(converter.decode(p, text_len, syms.data()));
+
+  line.chars.clear();
+  line.chars.reserve(cells);
+  line.clusters.clear();
+  size_t next = 0;
+  for (size_t i = 0; i < syms.size() && line.chars.size() < cells;) {
+    bool wide;
+    if (next < clusters.size() && clusters[next].first == line.chars.size()) {
+      size_t len = clusters[next].second / 2;
+      wide = clusters[next].second & 1;
+      line.chars.push_back(CLUSTER_CELL | line.clusters.size());
+      line.clusters.emplace_back(&syms[i], len);
+      i += len;
+      ++next;
+    } else {
+      wide = unicode::width(syms[i]) == 2;
+      line.chars.push_back(syms[i++]);
+    }
+    if (wide && line.chars.size() < cells) {
+      line.chars.push_back(WIDE_TAIL_CELL);
+    }
+  }
+  return true;
+}
+
+std::string Scrollback::text(size_t n) {
+  if (_joining && n == 0) {
+    return joining_text();
+  }
+  const char *p;
+  size_t len;
+  if (!find(n - _joining, p, len)) {
+    return std::string();
+  }
+
+  std::string text(line_text(p, len));
+  for (char &c : text) {
+    if (c == '\0') {
+      c = ' ';
+    }
+  }
+  return text;
+}
+
+// The text of the line being joined, as returned by text()
+std::string Scrollback::joining_text() const {
+  std::string text;
+  char u8[4];
+  for (char32_t cell : _line.chars) {
+    if (cell == WIDE_TAIL_CELL) {
+      continue;
+    }
+    if (cell == EMPTY_CELL) {
+      text.push_back(' ');
+    } else if (cell & CLUSTER_CELL) {
+      for (char32_t sym : _line.clusters[cell & ~CLUSTER_CELL]) {
+        text.append(u8, unicode::Utf8To32Converter::reverse(u8, sym));
+      }
+    } else {
+      text.append(u8, unicode::Utf8To32Converter::reverse(u8, cell));
+    }
+  }
+  return text;
+}
+
+size_t Scrollback::search(
+    std::string_view query,
+    bool ignore_case,
+    std::vector<size_t> &results,
+    size_t max_results) {
+  // empty cells read back as spaces
+  std::string needle(query);
+  std::string folded(query);
+  for (char &c : folded) {
+    c = fold(c);
+  }
+  if (ignore_case) {
+    needle = folded;
+  }
+  std::vector<uint32_t> trigrams;
+  for (size_t i = 0; i + 3 <= folded.size(); ++i) {
+    trigrams.push_back(trigram(&folded[i]));
+  }
+
+  size_t found = 0;
+  std::string text;
+  size_t base = 0;
+  if (_joining && max_results > 0) {
+    text = joining_text();
+    if (ignore_case) {
+      for (char &c : text) {
+        c = fold(c);
+      }
+    }
+    if (text.find(needle) != std::string::npos) {
+      results.push_back(0);
+      ++found;
+    }
+    base = 1;
+  }
+  for (size_t b = _blocks.size(); b-- > 0 && found < max_results;) {
+    Block &block = _blocks[b];
+    // one bit per group of lines that may hold the query
+    uint32_t groups = UINT32_MAX;
+    if (block.cold && !trigrams.empty()) {
+      groups = 0;
+      for (size_t g = 0; g * FILTER_GROUP_LINES < block.lines; ++g) {
+        bool candidate = true;
+        for (size_t i = 0; candidate && i < trigrams.size(); ++i) {
+          candidate = filter_holds(block.filter, filter_key(trigrams[i], g));
+        }
+        groups |= uint32_t(candidate) << g;
+      }
+    }
+
+    for (size_t n = 0; groups && n < block.lines && found < max_results; ++n) {
+      size_t index = block.lines - 1 - n;
+      if (!(groups & uint32_t(1) << (index / FILTER_GROUP_LINES))) {
+        continue;
+      }
+      const char *p;
+      size_t len;
+      if (!find(block, index, p, len)) {
+        break;
+      }
+      search_text(p, len, ignore_case, text);
+      if (text.find(needle) != std::string::npos) {
+        results.push_back(base + n);
+        ++found;
+      }
+    }
+    base += block.lines;
+  }
+  return found;
+}
+
+void Scrollback::clear() {
+  _blocks.clear();
+  _line = ScrollbackLine();
+  _joining = false;
+  _size = 0;
+  _bytes = 0;
+  _cache_serial = UINT64_MAX;
+  _cache_data.clear();
+  _cache_offsets.clear();
+}
+
+// Compress a full block, and build its trigram filter. The filter holds
+// each trigram once per group of lines it occurs in, so that a query whose
+// trigrams are only found scattered over a block does not match it.
+void Scrollback::freeze(Block &block) {
+  std::vector<uint32_t> keys;
+  std::string text;
+  for (size_t i = 0; i < block.lines; ++i) {
+    size_t start = block.offsets[i];
+    size_t end = i + 1 < block.lines ? block.offsets[i + 1] : block.data.size();
+    search_text(block.data.data() + start, end - start, true, text);
+    for (size_t j = 0; j + 3 <= text.size(); ++j) {
+      keys.push_back(filter_key(trigram(&text[j]), i / FILTER_GROUP_LINES));
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  size_t bits = std::max<size_t>(64, keys.size() * FILTER_BITS_PER_KEY + 63) / 64 * 64;
+  block.filter.assign(bits / 64, 0);
+  for (uint32_t key : keys) {
+    for (unsigned int i = 0; i < FILTER_HASHES; ++i) {
+      size_t bit = filter_bit(key, i, bits);
+      block.filter[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+  }
+  _bytes += bits / 8;
+
+  std::string packed;
+  lz::compress(block.data.data(), block.data.size(), packed);
+  _bytes -= block.data.size() + block.offsets.size() * sizeof(uint32_t);
+  _bytes += packed.size();
+  block.data.swap(packed);
+  block.offsets = std::vector<uint32_t>();
+  block.cold = true;
+}
+
+// Drop the oldest blocks until the history fits the budget. The block being
+// filled is always kept.
+void Scrollback::evict() {
+  while (_bytes > _byte_budget && _blocks.size() > 1) {
+    Block &block = _blocks.front();
+    _bytes -= block.data.size() + block.offsets.size() * sizeof(uint32_t);
+    _bytes -= block.filter.size() * sizeof(uint64_t);
+    _size -= block.lines;
+    _blocks.pop_front();
+  }
+}
+
+bool Scrollback::find(size_t n, const char *&data, size_t &len) {
+  if (n >= _size) {
+    return false;
+  }
+
+  // walk back from the newest block
+  size_t b = _blocks.size() - 1;
+  while (n >= _blocks[b].lines) {
+    n -= _blocks[b].lines;
+    --b;
+  }
+  return find(_blocks[b], _blocks[b].lines - 1 - n, data, len);
+}
+
+bool Scrollback::find(Block &block, size_t index, const char *&data, size_t &len) {
+  const std::string *raw = &block.data;
+  const std::vector<uint32_t> *offsets = &block.offsets;
+  if (block.cold) {
+    if (_cache_serial != block.serial) {
+      _cache_serial = UINT64_MAX;
+      _cache_data.resize(block.raw_size);
+      if (!lz::decompress(
+          block.data.data(), block.data.size(), &_cache_data[0], block.raw_size)) {
+        return false;
+      }
+      _cache_offsets.clear();
+      const char *p = _cache_data.data();
+      for (uint32_t i = 0; i < block.lines; ++i) {
+        _cache_offsets.push_back(p - _cache_data.data());
+        p = skip_line(p);
+      }
+      _cache_serial = block.serial;
+    }
+    raw = &_cache_data;
+    offsets = &_cache_offsets;
+  }
+
+  size_t start = (*offsets)[index];
+  size_t end = index + 1 < offsets->size() ? (*offsets)[index + 1] : raw->size();
+  data = raw->data() + start;
+  len = end - start;
+  return true;
+}
+
+} // namespace screen
+} // namespace vtutils
@@ -0,0 +1,148 @@
+#ifndef VTUTILS_SCROLLBACK_H_
+#define VTUTILS_SCROLLBACK_H_
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "attr_table.h"
+#include "cluster_table.h"
+#include "screen.h"
+
+namespace vtutils {
+namespace screen {
+
+// A line of history, one entry per cell. Cells holding a cluster, with
+// CLUSTER_CELL set, index clusters.
+struct ScrollbackLine {
+  std::vector<char32_t> chars;
+  std::vector<Attr> attrs;
+  std::vector<std::u32string> clusters;
+  // the line goes on in the next newer one (or, for the newest line, on the
+  // top row of the screen) without a line break
+  bool wrapped = false;
+};
+
+// History of the lines scrolled off the top of a screen.
+//
+// Lines are kept as the application wrote them, not as the screen laid
+// them out: the rows of a line the screen wrapped are pushed with wrapped
+// set, and joined back into one line. Lines are only split into rows again
+// when shown, at the width of the view (see wrap_line), so resizing the
+// screen leaves the history untouched whatever its length. The line being
+// joined is held apart until its last row is pushed, and reads as line 0.
+// Lines longer than MAX_LINE_CELLS are stored in pieces, all but the last
+// one wrapped.
+//
+// Lines are serialized compactly (utf-8 text plus attribute runs) into
+// blocks of BLOCK_LINES lines. The newest HOT_BLOCKS blocks are kept as is;
+// older blocks are compressed, and only decompressed again when a line in
+// them is read. The most recently decompressed block is cached, so reading
+// neighbouring lines in turn decompresses each block once.
+//
+// Memory is bounded by a byte budget, counting the stored (possibly
+// compressed) block data and search filters. When it is exceeded, whole
+// blocks are dropped from the old end, so the history shrinks by
+// BLOCK_LINES lines at a time.
+//
+// For search, each cold block carries a Bloom filter of the trigrams of its
+// text (case folded), built when the block is compressed. Trigrams are
+// entered once for each group of FILTER_GROUP_LINES lines they occur in,
+// and the filter is sized at FILTER_BITS_PER_KEY bits per entry, so it
+// stays sparse however varied the text. A search only decompresses the
+// cold blocks with a group whose filter entries hold every trigram of the
+// query, and only reads the lines of those groups; hot blocks are read as
+// they are. Queries shorter than a trigram read every block.
+class Scrollback {
+public:
+  static const size_t BLOCK_LINES = 256;
+  static const size_t HOT_BLOCKS = 4;
+  static const size_t FILTER_GROUP_LINES = 32;
+  static const size_t FILTER_BITS_PER_KEY = 8;
+  static const size_t MAX_LINE_CELLS = 16384;
+
+  explicit Scrollback(size_t byte_budget);
+
+  // Append a row of num cells, the newest in the history, looking up
+  // attributes and clusters in the tables. If wrapped is set, the line goes
+  // on in the next row pushed. Trailing empty cells with the default
+  // attributes are not stored.
+  void push(
+      const char32_t *chars,
+      const attr_id *attrs,
+      size_t num,
+      const AttrTable &table,
+      const ClusterTable &cluster_table,
+      bool wrapped);
+
+  // number of lines held
+  size_t size() const { return _size + _joining; }
+  // bytes used by the stored block data
+  size_t bytes() const { return _bytes; }
+  size_t byte_budget() const { return _byte_budget; }
+  void set_byte_budget(size_t byte_budget);
+
+  // Line n of the history, 0 being the newest. Returns false if n is out of
+  // range.
+  bool get(size_t n, ScrollbackLine &line);
+  // The text of line n as utf-8, with empty cells as spaces
+  std::string text(size_t n);
+
+  // Find the lines containing query, newest first, appending their numbers
+  // to results until max_results are found. Case is ignored for ASCII
+  // letters if ignore_case is set. Returns the number of lines found.
+  size_t search(
+      std::string_view query,
+      bool ignore_case,
+      std::vector<size_t> &results,
+      size_t max_results = SIZE_MAX);
+
+  void clear();
+
+private:
+  struct Block {
+    // serialized lines; lz compressed once the block is cold
+    std::string data;
+    // size of the uncompressed data
+    uint32_t raw_size = 0;
+    uint32_t lines = 0;
+    bool cold = false;
+    // start of each line in data, for hot blocks only
+    std::vector<uint32_t> offsets;
+    // Bloom filter of the trigrams of each group of lines of a cold block
+    std::vector<uint64_t> filter;
+    // unique over the life of the Scrollback, to identify cached blocks
+    uint64_t serial;
+  };
+
+  // oldest first; the last block is the one being filled
+  std::deque<Block> _blocks;
+  size_t _size = 0;
+  size_t _bytes = 0;
+  size_t _byte_budget;
+  uint64_t _next_serial = 0;
+  // the rows of the newest line so far, while it is wrapped
+  ScrollbackLine _line;
+  bool _joining = false;
+
+  // the last cold block read, uncompressed
+  uint64_t _cache_serial = UINT64_MAX;
+  std::string _cache_data;
+  std::vector<uint32_t> _cache_offsets;
+
+  void store(const ScrollbackLine &line);
+  std::string joining_text() const;
+  void freeze(Block &block);
+  void evict();
+  // Find the serialized line n. Returns false if n is out of range.
+  bool find(size_t n, const char *&data, size_t &len);
+  // Find the serialized line index of block, decompressing it if needed
+  bool find(Block &block, size_t index, const char *&data, size_t &len);
+};
+
+} // namespace screen
+} // namespace vtutils
+
+#endif /* VTUTILS_SCROLLBACK_H_ */
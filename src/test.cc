@@ -4,7 +4,7 @@
 #include <iomanip>
 #include <fstream>
 #include <sstream>
-#include <bits/stdio2.h>
+#include <cstdio>
 #include <ncurses.h>
 
 #include "vte.h"
@@ -26,11 +26,11 @@ std::string yellow = "\033[38;5;0;48;5;11m";
 std::string green = "\033[38;5;15;48;5;2m";
 
 void log(
-    std::string file,
+    const char *file,
     int line,
-    std::string func,
+    const char *func,
     LogLevel level,
-    std::string format,
+    const char *format,
     va_list args) {
 
   seconds_t d = std::chrono::system_clock::now() - start;
@@ -53,7 +53,7 @@ void log(
   err << std::setw(13) << std::fixed << std::right << d.count() << std::setw(0) << black << " ";
   err << file << '#' << func << '[' << line << "]: " << std::flush;
   char buf[256];
-  std::vsnprintf(buf, 255, format.c_str(), args);
+  std::vsnprintf(buf, 255, format, args);
   err << std::string(buf) << std::endl;
 }
 
@@ -68,7 +68,7 @@ WINDOW* do_curses() {
   return window;
 }
 
-int main() {
+int main(int argc, char **argv) {
   err << "In main!" << std::endl;
 
   WINDOW *window = do_curses();
@@ -80,7 +80,10 @@ int main() {
 //  istringstream("\xf6\xa4\x13""asdf\n") >> vte;
 ////  istringstream(U"ᚳ᛫ᛗᛁᚳᛚ\n") >> vte;
 
-  std::ifstream("/home/lsanderson/from_screen") >> vte;
+  const char *path = argc > 1 ? argv[1] : "/home/lsanderson/from_screen";
+  if (!vte.input_file(path)) {
+    err << "Unable to read " << path << std::endl;
+  }
   err << "Done!\n";
   return 0;
 }
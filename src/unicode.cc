@@ -1,16 +1,106 @@
 #include "unicode.h"
 
+#include <cstdint>
 #include <string>
 
+#include "unicode_width.h"
+
+// VTUTILS_UNICODE_NO_SIMD leaves out the SSE2 and AVX2 paths, for the tests
+#if defined(__GNUC__) && defined(__SSE2__) && !defined(VTUTILS_UNICODE_NO_SIMD)
+#include <immintrin.h>
+#define VTUTILS_HAVE_SSE2 1
+#endif
+
 namespace vtutils {
 namespace unicode {
   
 namespace {
 static const char32_t UTF_REPLACEMENT = 0xFFFD;
+
+// Widens the run of ASCII chars starting at in, up to end, into out. Returns
+// the position of the first non-ASCII char (or end); out is advanced past the
+// code points written.
+typedef const unsigned char* (*ascii_fn)(
+    const unsigned char *in,
+    const unsigned char *end,
+    char32_t *&out);
+
+static const unsigned char* ascii_scalar(
+    const unsigned char *in,
+    const unsigned char *end,
+    char32_t *&out) {
+  while (in < end && *in < 0x80) {
+    *out++ = *in++;
+  }
+  return in;
+}
+
+#ifdef VTUTILS_HAVE_SSE2
+static const unsigned char* ascii_sse2(
+    const unsigned char *in,
+    const unsigned char *end,
+    char32_t *&out) {
+  const __m128i zero = _mm_setzero_si128();
+  while (end - in >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*) in);
+    int mask = _mm_movemask_epi8(v);
+    if (mask != 0) {
+      // finish the ASCII prefix of this block
+      return ascii_scalar(in, in + __builtin_ctz(mask), out);
+    }
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+    _mm_storeu_si128((__m128i*) out, _mm_unpacklo_epi16(lo, zero));
+    _mm_storeu_si128((__m128i*) (out + 4), _mm_unpackhi_epi16(lo, zero));
+    _mm_storeu_si128((__m128i*) (out + 8), _mm_unpacklo_epi16(hi, zero));
+    _mm_storeu_si128((__m128i*) (out + 12), _mm_unpackhi_epi16(hi, zero));
+    in += 16;
+    out += 16;
+  }
+  return ascii_scalar(in, end, out);
+}
+
+__attribute__((target("avx2")))
+static const unsigned char* ascii_avx2(
+    const unsigned char *in,
+    const unsigned char *end,
+    char32_t *&out) {
+  while (end - in >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*) in);
+    unsigned int mask = _mm256_movemask_epi8(v);
+    if (mask != 0) {
+      return ascii_scalar(in, in + __builtin_ctz(mask), out);
+    }
+    for (int i = 0; i < 32; i += 8) {
+      __m128i b = _mm_loadl_epi64((const __m128i*) (in + i));
+      _mm256_storeu_si256((__m256i*) (out + i), _mm256_cvtepu8_epi32(b));
+    }
+    in += 32;
+    out += 32;
+  }
+  return ascii_sse2(in, end, out);
+}
+#endif
+
+static ascii_fn select_ascii() {
+#ifdef VTUTILS_HAVE_SSE2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return ascii_avx2;
+  }
+  return ascii_sse2;
+#else
+  return ascii_scalar;
+#endif
+}
+
+static inline bool is_continuation(unsigned char c) {
+  return (c & 0xC0) == 0x80;
+}
 }
 
 bool Utf8To32Converter::put(char ch, char32_t &code_point) {
-  char32_t c = ch;
+  char32_t c = (unsigned char) ch;
 
   switch (_state) {
     case UTF8_START:
@@ -69,6 +159,64 @@ bool Utf8To32Converter::put(char ch, char32_t &code_point) {
   return false;
 }
 
+size_t Utf8To32Converter::decode(const char *in, size_t len, char32_t *out) {
+  static const ascii_fn ascii = select_ascii();
+
+  const unsigned char *p = (const unsigned char*) in;
+  const unsigned char *end = p + len;
+  char32_t *o = out;
+
+  while (p < end) {
+    if (_state != UTF8_START) {
+      // resume a sequence started in a previous call, or after an error
+      if (put(*p++, *o)) {
+        ++o;
+      }
+      continue;
+    }
+
+    p = ascii(p, end, o);
+    if (p == end) {
+      break;
+    }
+
+    // Decode complete, well-formed sequences directly. Anything else (invalid
+    // input, or a sequence split across blocks) goes through put.
+    unsigned char c = *p;
+    size_t avail = end - p;
+    if (c >= 0xC2 && c < 0xE0) {
+      if (avail >= 2 && is_continuation(p[1])) {
+        *o++ = (c & 0x1F) << 6 | (p[1] & 0x3F);
+        p += 2;
+        continue;
+      }
+    } else if ((c & 0xF0) == 0xE0) {
+      if (avail >= 3 && is_continuation(p[1]) && is_continuation(p[2])) {
+        *o++ = (c & 0x0F) << 12 | (p[1] & 0x3F) << 6 | (p[2] & 0x3F);
+        p += 3;
+        continue;
+      }
+    } else if ((c & 0xF8) == 0xF0) {
+      if (avail >= 4
+          && is_continuation(p[1])
+          && is_continuation(p[2])
+          && is_continuation(p[3])) {
+        *o++ = (c & 0x07) << 18
+            | (p[1] & 0x3F) << 12
+            | (p[2] & 0x3F) << 6
+            | (p[3] & 0x3F);
+        p += 4;
+        continue;
+      }
+    }
+    if (put(*p++, *o)) {
+      ++o;
+    }
+  }
+
+  return o - out;
+}
+
 bool Utf8To32Converter::reject(char32_t &code_point) {
   code_point = UTF_REPLACEMENT;
   reset();
@@ -80,6 +228,118 @@ void Utf8To32Converter::reset() {
   _code_point = 0;
 }
 
+namespace {
+// Widths are looked up in two levels: the page of 256 code points a code
+// point is on picks a row of its widths, packed 2 bits each. Pages of a
+// single width share the rows at the start of the table, so only the pages
+// with a mix of widths take up a row of their own. The table is built from
+// WIDTH_RANGES at compile time.
+static constexpr unsigned int PAGE_SHIFT = 8;
+static constexpr unsigned int PAGE_SIZE = 1 << PAGE_SHIFT;
+static constexpr unsigned int NUM_PAGES = 0x110000 >> PAGE_SHIFT;
+static constexpr size_t NUM_RANGES = sizeof(WIDTH_RANGES) / sizeof(WIDTH_RANGES[0]);
+// rows of the pages all of width 0, 1 and 2, in that order
+static constexpr unsigned int NUM_UNIFORM_ROWS = 3;
+
+// The first range from range on that does not end before page
+static constexpr size_t first_range(unsigned int page, size_t range) {
+  while (range < NUM_RANGES && WIDTH_RANGES[range].last < page << PAGE_SHIFT) {
+    ++range;
+  }
+  return range;
+}
+
+// The width of all the code points of page, or -1 if they differ. range is
+// the first range not ending before the page.
+static constexpr int page_width(unsigned int page, size_t range) {
+  char32_t first = page << PAGE_SHIFT;
+  char32_t last = first + PAGE_SIZE - 1;
+  if (range == NUM_RANGES || WIDTH_RANGES[range].first > last) {
+    return 1;
+  }
+  if (WIDTH_RANGES[range].first <= first && WIDTH_RANGES[range].last >= last) {
+    return WIDTH_RANGES[range].width;
+  }
+  return -1;
+}
+
+static constexpr unsigned int count_rows() {
+  unsigned int rows = NUM_UNIFORM_ROWS;
+  size_t range = 0;
+  for (unsigned int page = 0; page < NUM_PAGES; ++page) {
+    range = first_range(page, range);
+    if (page_width(page, range) < 0) {
+      ++rows;
+    }
+  }
+  return rows;
+}
+
+static constexpr unsigned int NUM_ROWS = count_rows();
+static_assert(NUM_ROWS <= 256, "width table rows must fit the page index");
+
+struct WidthTable {
+  uint8_t index[NUM_PAGES];
+  uint8_t rows[NUM_ROWS][PAGE_SIZE / 4];
+};
+
+static constexpr WidthTable make_width_table() {
+  WidthTable table{};
+  for (unsigned int i = 0; i < PAGE_SIZE / 4; ++i) {
+    table.rows[1][i] = 0x55;
+    table.rows[2][i] = 0xaa;
+  }
+  unsigned int rows = NUM_UNIFORM_ROWS;
+  size_t range = 0;
+  for (unsigned int page = 0; page < NUM_PAGES; ++page) {
+    range = first_range(page, range);
+    int width = page_width(page, range);
+    if (width >= 0) {
+      table.index[page] = width;
+      continue;
+    }
+    table.index[page] = rows;
+    size_t r = range;
+    for (unsigned int i = 0; i < PAGE_SIZE; ++i) {
+      char32_t code_point = page << PAGE_SHIFT | i;
+      while (r < NUM_RANGES && WIDTH_RANGES[r].last < code_point) {
+        ++r;
+      }
+      if (r < NUM_RANGES && WIDTH_RANGES[r].first <= code_point) {
+        width = WIDTH_RANGES[r].width;
+      } else {
+        width = 1;
+      }
+      table.rows[rows][i / 4] |= width << (i % 4 * 2);
+    }
+    ++rows;
+  }
+  return table;
+}
+
+static constexpr WidthTable WIDTH_TABLE = make_width_table();
+} // namespace
+
+int lookup_width(char32_t code_point) {
+  if (code_point >= 0x110000) {
+    return 1;
+  }
+  unsigned int row = WIDTH_TABLE.index[code_point >> PAGE_SHIFT];
+  unsigned int i = code_point & (PAGE_SIZE - 1);
+  return WIDTH_TABLE.rows[row][i / 4] >> (i % 4 * 2) & 3;
+}
+
+int width(const char32_t *syms, size_t num) {
+  int base = width(syms[0]);
+  for (size_t i = 1; i < num && base == 1; ++i) {
+    // VARIATION SELECTOR-16 asks for emoji presentation
+    if (syms[i] == 0xfe0f) {
+      base = 2;
+    }
+  }
+  return base;
+}
+
 size_t Utf8To32Converter::reverse(char* out, char32_t code_point) {
   int len = 0;
   if (code_point >= 0x80) {
@@ -99,19 +359,19 @@ size_t Utf8To32Converter::reverse(char* out, char32_t code_point) {
         // 4-byte encoding - first, encode bits 18-20
         out[len++] = 0xf0 | (0x07 & code_point >> 18);
         // next, bits 12-17
-        out[len++] = 0x08 | (0x3f & code_point >> 12);
+        out[len++] = 0x80 | (0x3f & code_point >> 12);
       } else {
         // 3-byte encoding - first, encode bits 12-15
         out[len++] = 0xe0 | (0x0f & code_point >> 12);
       }
       // next, bits 6-11
-      out[len++] = 0x08 | (0x3f & code_point >> 6);
+      out[len++] = 0x80 | (0x3f & code_point >> 6);
     } else {
       // 2-byte encoding - first, encode bits 6-10
       out[len++] = 0xc0 | (0x1f & code_point >> 6);
     }
     // next, bits 0-5
-    out[len++] = 0x08 | (0x3f & code_point);
+    out[len++] = 0x80 | (0x3f & code_point);
   } else {
     out[len++] = code_point;
   }
@@ -1,6 +1,7 @@
 #ifndef VTUTILS_UNICODE_H_
 #define VTUTILS_UNICODE_H_
 
+#include <cstddef>
 #include <memory>
 
 namespace vtutils {
@@ -47,10 +48,24 @@ public:
   // not complete it, then nothing is written to code_point, and false is
   // returned.
   bool put(char c, char32_t &code_point);
+
+  // Decode a block of utf-8 chars, writing the resulting code points to out,
+  // and returning the number of code points written. The result is identical
+  // to calling put for each char in turn, including the replacement
+  // characters for invalid input, and any sequence left incomplete at the end
+  // of the block is resumed by the next call. At most one code point is
+  // produced per char, so out must have room for len code points. Runs of
+  // ASCII are widened with SSE2 or AVX2, as supported by the running CPU.
+  size_t decode(const char *in, size_t len, char32_t *out);
   
   // Reset the state of this converter
   void reset();
 
+  // Returns true if no multi-byte sequence is in progress
+  bool idle() const {
+    return _state == UTF8_START;
+  }
+
   static size_t reverse(char* out, char32_t code_point);
 
 private:
@@ -60,6 +75,38 @@ private:
   bool reject(char32_t &code_point);
 };
 
+int lookup_width(char32_t code_point);
+
+// The number of cells code_point takes up on screen: 0 for combining marks
+// and other zero width characters, 2 for wide characters (East Asian Wide
+// and Fullwidth, which includes most emoji), and 1 for everything else.
+// The widths come from an in-tree table (see unicode_width.h), so they do
+// not depend on the locale or the C library.
+inline int width(char32_t code_point) {
+  // nothing before the combining diacritical marks is zero width or wide
+  if (code_point < 0x300) {
+    return 1;
+  }
+  return lookup_width(code_point);
+}
+
+// The width of the grapheme cluster of num code points at syms: that of
+// its base character, or 2 if an emoji presentation selector asks for it
+int width(const char32_t *syms, size_t num);
+
+// true if sym, following prev, belongs to the same grapheme cluster as
+// prev. A simplification of the Unicode rules that covers what a terminal
+// needs: zero width code points (combining marks, joiners, variation
+// selectors), emoji modifiers, and whatever follows a zero width joiner.
+inline bool extends_cluster(char32_t prev, char32_t sym) {
+  if (sym < 0x300) {
+    return false;
+  }
+  return width(sym) == 0
+      || prev == 0x200d
+      || (sym >= 0x1f3fb && sym <= 0x1f3ff);
+}
+
 } // end namespace vtutils
 } // end namespace unicode
 
@@ -7,7 +7,9 @@
 #include <memory>
 #include <stdarg.h>
 #include <stdexcept>
+#include <sys/types.h>
 #include <string>
+#include <string_view>
 
 #include "charsets.h"
 #include "config.h"
@@ -25,6 +27,12 @@ enum LogLevel {
   LOG_ERROR
 };
 
+// Log statements below this level are compiled out. Normally set by configure
+// (--with-log-level).
+#ifndef VTUTILS_LOG_LEVEL
+#define VTUTILS_LOG_LEVEL LOG_INFO
+#endif
+
 /**
  * Logging Callback
  *
@@ -39,27 +47,25 @@ enum LogLevel {
  * instead of such a function to disable logging.
  */
 typedef void (*log_cb) (
-    std::string file,
+    const char *file,
     int line,
-    std::string func,
+    const char *func,
     LogLevel level,
-    std::string format,
+    const char *format,
     va_list args);
 
 static inline
 void log_format(log_cb logger,
-        std::string file,
+        const char *file,
         int line,
-        std::string func,
+        const char *func,
         LogLevel level,
-        std::string format,
+        const char *format,
         ...) {
   va_list list;
-  if (logger) {
-    va_start(list, format);
-    logger(file, line, func, level, format, list);
-    va_end(list);
-  }
+  va_start(list, format);
+  logger(file, line, func, level, format, list);
+  va_end(list);
 }
 
 #define LOG_DEFAULT __FILE__, __LINE__, __func__
@@ -73,12 +79,20 @@ void log_format(log_cb logger,
 #define log_warn(obj, format, ...) \
     log_printf((obj), (LOG_WARN), (format), ##__VA_ARGS__)
 
+// The level checks happen before any of the arguments are evaluated. Levels
+// below VTUTILS_LOG_LEVEL are constant-false, and compiled out.
 #define log_printf(obj, level, format, ...) \
-    log_format((obj)->_logger, \
+    do { \
+      if ((level) >= VTUTILS_LOG_LEVEL \
+          && (obj)->_logger \
+          && (level) >= (obj)->_log_level) { \
+        log_format((obj)->_logger, \
             LOG_DEFAULT, \
             (level), \
             (format), \
-            ##__VA_ARGS__)
+            ##__VA_ARGS__); \
+      } \
+    } while (0)
 
 
 
@@ -122,6 +136,25 @@ enum ParserAction {
 
 // max CSI arguments
 const int CSI_ARG_MAX = 16;
+// max CSI intermediate characters retained
+const int CSI_INT_MAX = 4;
+
+// size of the buffer collecting replies (DA, DSR, ...) to the application
+const size_t WRITE_BUF_SIZE = 256;
+
+// size of the blocks read by the stream and file descriptor readers
+const size_t INPUT_BUF_SIZE = 64 * 1024;
+// size of the spans a memory-mapped file is fed to the parser in
+const size_t INPUT_MAP_SPAN = 1024 * 1024;
+
+// default limit on the size of an OSC string, in bytes
+const size_t OSC_MAX_DEFAULT = 4096;
+
+// What to do with OSC strings longer than the limit
+enum OscOverflow {
+  OSC_TRUNCATE, // deliver the string cut at the limit
+  OSC_DISCARD,  // drop the string entirely
+};
 
 // Saved state
 struct saved_state {
@@ -138,18 +171,57 @@ struct saved_state {
 // ( https://www.freedesktop.org/wiki/Software/kmscon/libtsm/ )
 // This is a state machine that processes terminal escape sequences, and translates them into
 // standardized calls to Screen.
-class Vte {
+//
+// ScreenT is the screen type the drawing calls are made on. Vte (below) uses
+// the polymorphic screen::Screen; instantiating with a concrete (ideally
+// final) Screen implementation lets the compiler devirtualize and inline
+// those calls. See vte_impl.h for instantiating other screen types.
+template <class ScreenT>
+class BasicVte {
  public:
-  Vte(screen::Screen &s, log_cb l) : _screen(s), _logger(l) {
+  BasicVte(ScreenT &s, log_cb l)
+      : _screen(s),
+        _logger(l),
+        _osc_buf(new char[OSC_MAX_DEFAULT]),
+        _osc_max(OSC_MAX_DEFAULT) {
     reset();
   }
-  Vte(screen::Screen &s): Vte(s, nullptr) { };
+  BasicVte(ScreenT &s): BasicVte(s, nullptr) { };
+
+  // Only log messages at or above this level. Messages below
+  // VTUTILS_LOG_LEVEL are never logged, regardless of this setting.
+  void set_log_level(LogLevel level) {
+    _log_level = level;
+  }
 
   // Handle a single character. Handles unicode and bit-size enforcement. Logic
   // pushed to parse_data
-  void input(char c);
+  void input(char c) {
+    input(&c, 1);
+  }
+  // Handle a span of characters. While in the ground state, runs of printable
+  // text are sent straight to the screen, bypassing the per-character state
+  // machine. Any replies to the application are collected, and sent to the
+  // screen in one write once the whole span is handled, after which the
+  // screen is flushed.
+  void input(const char *data, size_t len);
   // convenience wrapper around input above
-  void input(std::string s);
+  void input(std::string_view s) {
+    input(s.data(), s.size());
+  }
+  // Read and handle everything from the file descriptor, in large blocks,
+  // until end of file or until a read would block. Returns the number of
+  // bytes handled, or -1 (with errno set) if a read failed.
+  ssize_t input_fd(int fd);
+  // Handle the full contents of the file at path. Regular files are memory
+  // mapped and parsed in place; anything else is read with input_fd.
+  // Returns false (with errno set) if the file could not be read.
+  bool input_file(const char *path);
+
+  // Limit the size of OSC strings (window titles, hyperlinks, clipboard
+  // data, ...). The buffer is allocated here once, and reused for every
+  // string, so collecting never allocates.
+  void set_osc_limit(size_t max, OscOverflow overflow);
 
   // reset this terminal
   void reset();
@@ -159,8 +231,9 @@ class Vte {
 
  private:
   // initialized state
-  screen::Screen &_screen;
+  ScreenT &_screen;
   log_cb _logger;
+  LogLevel _log_level = LOG_TRACE;
   //tsm_vte_write_cb write_cb;
   
   // state machine state
@@ -169,8 +242,21 @@ class Vte {
   unsigned int _csi_argc;
   int _csi_argv[CSI_ARG_MAX];
   unsigned int _csi_flags;
+  char _csi_int[CSI_INT_MAX];
+  unsigned int _csi_intc;
   unsigned int _parse_cnt = 0;
 
+  // replies to the application, waiting to be written
+  char _write_buf[WRITE_BUF_SIZE];
+  size_t _write_len = 0;
+
+  // OSC string collection
+  std::unique_ptr<char[]> _osc_buf;
+  size_t _osc_max;
+  size_t _osc_len = 0;
+  bool _osc_overflow = false;
+  OscOverflow _osc_overflow_mode = OSC_TRUNCATE;
+
   // UTF-8 state machine
   vtutils::unicode::Utf8To32Converter _utf8_converter;
 
@@ -196,10 +282,10 @@ class Vte {
   unsigned int _alt_cursor_y;
 
   // Entry for all parsing
+  void input_char(char c);
   void parse_data(char32_t raw);
 
   // private implementation details
-  void do_trans(char32_t data, ParserState state, ParserAction act);
   void do_action(char32_t data, ParserAction action);
   void do_execute(char32_t ctrl);
   void do_clear();
@@ -207,10 +293,17 @@ class Vte {
   void do_param(char32_t data);
   void do_esc(char32_t data);
   void do_csi(char32_t data);
+  void do_dcs_start(char32_t data);
+  void do_dcs_end(char32_t data);
+  void do_osc_start();
+  void do_osc_collect(const char *data, size_t len);
+  void do_osc_end(char32_t data);
 
   // Redirection Interactions (Terminal invoking commands on terminal)
   void write_console(char32_t sym);
-  void write(const std::string u8);
+  void write_console(const char *run, size_t len);
+  void write(std::string_view u8);
+  void flush_write();
   void send_primary_da();
   bool set_charset(charsets::charset *set);
   char32_t map_char(char32_t val);
@@ -231,7 +324,14 @@ class Vte {
 };
 
 // Provide input-stream handling
-std::istream& operator>>(std::istream &in, Vte &vte);
+template <class ScreenT>
+std::istream& operator>>(std::istream &in, BasicVte<ScreenT> &vte);
+
+// The Virtual Terminal Emulator, drawing on any screen::Screen
+typedef BasicVte<screen::Screen> Vte;
+
+extern template class BasicVte<screen::Screen>;
+extern template std::istream& operator>>(std::istream &in, Vte &vte);
 
 
 } // namespace vte
@@ -0,0 +1,54 @@
+// Checks the alternate screen modes 1047, 1048 and 1049 on a GridScreen,
+// driven both by a BasicVte<GridScreen> and through the virtual Screen
+// interface: the main screen and its cursor come back on leaving, and the
+// alternate screen starts out blank.
+
+#include <cstdio>
+#include <string>
+
+#include "grid_screen.h"
+#include "vte_impl.h"
+
+using namespace vtutils;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what, const char *vte_type) {
+  if (!ok) {
+    std::printf("FAIL: %s, %s\n", what, vte_type);
+    ++failures;
+  }
+}
+
+template <class VteT>
+static void check_modes(const char *vte_type) {
+  screen::GridScreen screen(20, 5);
+  VteT vte(screen);
+  vte.input("main\x1b[3;6H");
+
+  // 1049 saves the cursor, and clears the alternate screen on entering it
+  vte.input("\x1b[?1049halt\x1b[?1049l");
+  check(screen.line(0) == "main", "main screen kept by 1049", vte_type);
+  check(screen.cursor_x() == 5 && screen.cursor_y() == 2, "cursor restored by 1049", vte_type);
+  vte.input("\x1b[?1049h");
+  check(screen.line(0).empty() && screen.line(2).empty(), "alternate screen cleared by 1049", vte_type);
+  check(screen.cursor_x() == 5 && screen.cursor_y() == 2, "cursor kept entering 1049", vte_type);
+  vte.input("\x1b[?1049l");
+
+  // 1047 clears the alternate screen on leaving it, and leaves the cursor
+  // to 1048
+  vte.input("\x1b[?1048h\x1b[?1047h\x1b[Halt\x1b[?1047l\x1b[?1048l");
+  check(screen.line(0) == "main", "main screen kept by 1047", vte_type);
+  check(screen.cursor_x() == 5 && screen.cursor_y() == 2, "cursor restored by 1048", vte_type);
+  vte.input("\x1b[?47h");
+  check(screen.line(0).empty(), "alternate screen cleared by 1047", vte_type);
+  vte.input("\x1b[?47l");
+}
+
+int main() {
+  check_modes<vte::BasicVte<screen::GridScreen>>("BasicVte<GridScreen>");
+  check_modes<vte::Vte>("Vte");
+
+  std::printf("%d failures\n", failures);
+  return failures ? 1 : 0;
+}
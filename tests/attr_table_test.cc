@@ -0,0 +1,64 @@
+// Checks that AttrHash agrees with operator== on Attr and tells RGB colors
+// apart, and that AttrTable hands out one ID per distinct Attr.
+
+#include <cstdio>
+
+#include "attr_table.h"
+
+using namespace vtutils::screen;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+  if (!ok) {
+    std::printf("FAIL: %s\n", what);
+    ++failures;
+  }
+}
+
+static Attr rgb(uint8_t r, uint8_t g, uint8_t b, bool background) {
+  Attr attr{};
+  Color &color = background ? attr.bg : attr.fg;
+  color.color_code = COLOR_CODE_RGB;
+  color.r = r;
+  color.g = g;
+  color.b = b;
+  return attr;
+}
+
+int main() {
+  AttrHash hash;
+  for (bool background : {false, true}) {
+    check(hash(rgb(1, 2, 3, background)) != hash(rgb(1, 2, 4, background)), "blue");
+    check(hash(rgb(1, 2, 3, background)) != hash(rgb(1, 3, 3, background)), "green");
+    check(hash(rgb(1, 2, 3, background)) != hash(rgb(2, 2, 3, background)), "red");
+    check(hash(rgb(0, 0, 0, background)) != hash(rgb(255, 255, 255, background)), "extremes");
+  }
+
+  // RGB values left over in indexed colors are not compared, so must not
+  // be hashed either
+  Attr a{};
+  Attr b{};
+  a.fg.color_code = b.fg.color_code = COLOR_CODE_RED;
+  a.fg.r = 10;
+  b.fg.r = 20;
+  check(a == b && hash(a) == hash(b), "indexed colors ignore RGB values");
+
+  // a truecolor gradient gets one stable ID per color
+  AttrTable table;
+  const unsigned int num = 30000;
+  for (unsigned int i = 0; i < num; ++i) {
+    attr_id id = table.intern(rgb(i >> 16, i >> 8, i, false));
+    check(id == table.intern(rgb(i >> 16, i >> 8, i, false)), "same ID for the same Attr");
+    if (id == DEFAULT_ATTR_ID) {
+      break;
+    }
+  }
+  check(table.size() == num + 1, "one ID per color");
+
+  if (failures) {
+    std::printf("%d failures\n", failures);
+    return 1;
+  }
+  return 0;
+}
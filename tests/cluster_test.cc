@@ -0,0 +1,52 @@
+// Checks that a GridScreen stores a grapheme cluster in one cell however
+// the input is split: between input calls, and across the chunks the Vte
+// decodes a long run in.
+
+#include <cstdio>
+#include <string>
+
+#include "grid_screen.h"
+#include "vte_impl.h"
+
+using namespace vtutils;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what, const std::string &input, size_t split) {
+  if (!ok) {
+    std::printf("FAIL: %s, \"%s\" split at byte %zu\n", what, input.c_str(), split);
+    ++failures;
+  }
+}
+
+// Prints input in two calls, split at every byte, and checks the text and
+// cursor column that result
+static void check_splits(const std::string &input, unsigned int cursor_x) {
+  for (size_t split = 0; split <= input.size(); ++split) {
+    screen::GridScreen screen(300, 2);
+    vte::BasicVte<screen::GridScreen> vte(screen);
+    vte.input(input.substr(0, split));
+    vte.input(input.substr(split));
+    check(screen.line(0) == input, "text", input, split);
+    check(screen.cursor_x() == cursor_x, "cursor column", input, split);
+  }
+}
+
+int main() {
+  // thumbs up, medium skin tone
+  check_splits("\xf0\x9f\x91\x8d\xf0\x9f\x8f\xbd.", 3);
+  // man, zero width joiner, woman, zero width joiner, girl
+  check_splits("\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9\xe2\x80\x8d\xf0\x9f\x91\xa7.", 3);
+  // e, combining acute accent
+  check_splits("e\xcc\x81.", 2);
+  // a narrow base keeps its width
+  check_splits("a\xe2\x80\x8d\xf0\x9f\x91\x8d.", 2);
+  // the Vte decodes a run 256 bytes at a time; the modifier starts the
+  // second chunk
+  check_splits(std::string(252, 'a') + "\xf0\x9f\x91\x8d\xf0\x9f\x8f\xbd", 254);
+  if (failures) {
+    std::printf("%d failures\n", failures);
+    return 1;
+  }
+  return 0;
+}
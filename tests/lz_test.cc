@@ -0,0 +1,101 @@
+// Checks that lz::decompress restores what lz::compress packed, for empty,
+// incompressible and highly repetitive data, and that it rejects malformed
+// blocks without writing past the output.
+
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "lz.h"
+
+using namespace vtutils;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what, size_t n) {
+  if (!ok) {
+    std::printf("FAIL: %s, case %zu\n", what, n);
+    ++failures;
+  }
+}
+
+static bool round_trip(const std::string &data, std::string &packed) {
+  packed.clear();
+  lz::compress(data.data(), data.size(), packed);
+  std::string out(data.size(), '\0');
+  return lz::decompress(packed.data(), packed.size(), &out[0], out.size())
+      && out == data;
+}
+
+int main() {
+  std::mt19937 rng(777);
+  std::string packed;
+
+  check(round_trip("", packed), "empty input", 0);
+  check(round_trip("abc", packed), "shorter than a match", 0);
+
+  for (size_t len : {1, 15, 16, 255, 270, 4096, 70000}) {
+    std::string noise(len, '\0');
+    for (char &c : noise) {
+      c = char(rng());
+    }
+    check(round_trip(noise, packed), "incompressible data", len);
+  }
+
+  // matches longer than the token holds, and overlapping their own output
+  std::string repeated(100000, 'x');
+  check(round_trip(repeated, packed), "one long match", 0);
+  check(packed.size() < 1000, "a long match compresses", 0);
+  std::string lines;
+  for (size_t i = 0; i < 3000; ++i) {
+    lines += "user@host:~/src$ make -j8 # " + std::to_string(i % 37) + "\n";
+  }
+  check(round_trip(lines, packed), "repetitive text", 0);
+  check(packed.size() < lines.size() / 4, "repetitive text compresses", 0);
+
+  // offsets beyond MAX_OFFSET are never used
+  std::string far = std::string(40, 'q') + std::string(70000, '\0') + std::string(40, 'q');
+  for (size_t i = 40; i < 70040; ++i) {
+    far[i] = char(rng());
+  }
+  check(round_trip(far, packed), "distant repeat", 0);
+
+  // truncated, corrupted and mis-sized blocks are rejected
+  round_trip(lines, packed);
+  std::string out(lines.size(), '\0');
+  for (size_t cut = 0; cut < packed.size(); cut += 1 + packed.size() / 200) {
+    check(!lz::decompress(packed.data(), cut, &out[0], out.size()), "truncated block", cut);
+  }
+  check(!lz::decompress(packed.data(), packed.size(), &out[0], out.size() - 1),
+      "output too small", 0);
+  out.resize(lines.size() + 1);
+  check(!lz::decompress(packed.data(), packed.size(), &out[0], out.size()),
+      "output too large", 0);
+  // a match reaching back before the start of the output
+  const char before_start[] = {0x10, 'a', 0x05, 0x00};
+  check(!lz::decompress(before_start, sizeof(before_start), &out[0], 10),
+      "offset before the start", 0);
+  const char zero_offset[] = {0x10, 'a', 0x00, 0x00};
+  check(!lz::decompress(zero_offset, sizeof(zero_offset), &out[0], 10), "zero offset", 0);
+  const char unfinished_length[] = {char(0xf0), char(0xff)};
+  check(!lz::decompress(unfinished_length, sizeof(unfinished_length), &out[0], 10),
+      "unfinished length", 0);
+
+  // random corruption either fails or stays within the output
+  for (size_t i = 0; i < 2000; ++i) {
+    std::string bad = packed;
+    for (size_t n = 1 + rng() % 4; n > 0; --n) {
+      bad[rng() % bad.size()] = char(rng());
+    }
+    std::string guarded(lines.size() + 64, '\x5a');
+    lz::decompress(bad.data(), bad.size(), &guarded[0], lines.size());
+    check(guarded.compare(lines.size(), 64, std::string(64, '\x5a')) == 0,
+        "corrupt block writes past the output", i);
+  }
+
+  if (failures) {
+    std::printf("%d failures\n", failures);
+    return 1;
+  }
+  return 0;
+}
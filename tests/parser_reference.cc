@@ -0,0 +1,12 @@
+// The parser with the rules evaluated for each character, as it was before
+// the transition table, for parser_test to compare against
+#define VTUTILS_VTE_REFERENCE_PARSER
+
+#include "vte_impl.h"
+#include "parser_run.h"
+
+std::string run_reference_parser(
+    const std::string &input,
+    const std::vector<size_t> &chunks) {
+  return run_parser(input, chunks);
+}
@@ -0,0 +1,39 @@
+#ifndef VTUTILS_TESTS_PARSER_RUN_H_
+#define VTUTILS_TESTS_PARSER_RUN_H_
+
+// Included by parser_test.cc, and by parser_reference.cc with
+// VTUTILS_VTE_REFERENCE_PARSER defined. The screen type is local to each
+// translation unit, so each gets its own instantiation of BasicVte.
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "debug_screen.h"
+
+namespace {
+
+class TestScreen : public vtutils::screen::DebugScreen {
+public:
+  using DebugScreen::DebugScreen;
+};
+
+// The DebugScreen log of input, fed to a new Vte in chunks of the given
+// sizes
+std::string run_parser(const std::string &input, const std::vector<size_t> &chunks) {
+  std::ostringstream out;
+  TestScreen screen(out);
+  vtutils::vte::BasicVte<TestScreen> vte(screen);
+  size_t pos = 0;
+  for (size_t i = 0; pos < input.size(); ++i) {
+    size_t len = std::min(chunks[i % chunks.size()], input.size() - pos);
+    vte.input(input.data() + pos, len);
+    pos += len;
+  }
+  return out.str();
+}
+
+} // namespace
+
+#endif /* VTUTILS_TESTS_PARSER_RUN_H_ */
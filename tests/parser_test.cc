@@ -0,0 +1,235 @@
+// Checks the parser's transition table against the rules it is built from:
+// entry by entry, and by comparing the screen calls of the two parsers on a
+// random corpus of text and escape sequences. Also checks that the fast
+// paths for runs of text, OSC strings and DCS data give the same screen
+// calls as feeding the corpus one byte at a time.
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "vte_impl.h"
+#include "parser_run.h"
+
+using namespace vtutils::vte;
+using namespace vtutils::vte::internal;
+
+std::string run_reference_parser(
+    const std::string &input,
+    const std::vector<size_t> &chunks);
+
+static int failures = 0;
+
+static void check(bool ok, const char *what, unsigned int state, unsigned int raw) {
+  if (!ok) {
+    if (failures < 20) {
+      std::printf("FAIL: %s, state %u, input 0x%x\n", what, state, raw);
+    }
+    ++failures;
+  }
+}
+
+// Every (state, byte class) entry against the rules, and every code point
+// sharing the last byte class against the rules for it
+static void check_table() {
+  for (unsigned int s = 0; s < STATE_COUNT; ++s) {
+    ParserState state = (ParserState) s;
+    for (unsigned int c = 0; c < BYTE_CLASS_COUNT; ++c) {
+      Transition t = transition(state, c);
+      const TableEntry &e = transition_table.entries[s][c];
+      check(e.action == t.action, "action", s, c);
+      if (t.state != STATE_NONE) {
+        check(e.state == t.state, "state", s, c);
+        check(e.exit == exit_action(state), "exit action", s, c);
+        check(e.entry == entry_action(t.state), "entry action", s, c);
+      } else {
+        check(e.state == state, "state kept", s, c);
+        check(e.exit == ACTION_NONE && e.entry == ACTION_NONE, "no exit or entry", s, c);
+      }
+    }
+
+    Transition last = transition(state, BYTE_CLASS_COUNT - 1);
+    for (char32_t raw = BYTE_CLASS_COUNT; raw < 0x110000; ++raw) {
+      Transition t = transition(state, raw);
+      check(t.state == last.state && t.action == last.action, "last byte class", s, raw);
+    }
+  }
+}
+
+// Random text and escape sequences, including malformed and cut off ones
+static std::string make_corpus(std::mt19937 &rng, size_t size) {
+  auto pick = [&](size_t n) { return size_t(rng() % n); };
+  auto params = [&](std::string &out) {
+    for (size_t n = pick(4); n > 0; --n) {
+      out += std::to_string(pick(3) ? pick(10) : pick(100000));
+      out += ";:"[pick(5) == 0];
+    }
+  };
+  static const char *const texts[] = {
+    "hello", " world", "\xc3\xa9", "\xe4\xb8\xad", "\xf0\x9f\x91\x8d", "e\xcc\x81",
+  };
+  static const char finals[] = "@ABCDEFGHIJKLMPSTXZ`abcdefghlmnqrsu";
+
+  std::string out;
+  while (out.size() < size) {
+    switch (pick(12)) {
+      case 0:
+        out += texts[pick(sizeof(texts) / sizeof(*texts))];
+        break;
+      case 1:
+        // C0 controls, including CAN and SUB
+        out.push_back(char(pick(0x20)));
+        break;
+      case 2:
+        out += "\x1b";
+        out.push_back(char(0x20 + pick(0x60)));
+        break;
+      case 3:
+      case 4:
+        out += "\x1b[";
+        if (pick(4) == 0) {
+          out.push_back("?>=!"[pick(4)]);
+        }
+        params(out);
+        if (pick(6) == 0) {
+          out.push_back(char(0x20 + pick(0x10)));
+        }
+        out.push_back(finals[pick(sizeof(finals) - 1)]);
+        break;
+      case 5:
+        out += "\x1b]";
+        params(out);
+        out += "some title";
+        out += pick(2) ? "\x07" : "\x1b\\";
+        break;
+      case 6:
+        out += "\x1bP";
+        params(out);
+        out += "q#0;2;0;0;0#0~~@@";
+        out += pick(4) ? "\x1b\\" : "\x18";
+        break;
+      case 7:
+        // C1 controls, encoded and raw
+        out += "\xc2";
+        out.push_back(char(0x80 + pick(0x20)));
+        break;
+      case 8:
+        out.push_back(char(0x80 + pick(0x80)));
+        break;
+      case 9:
+        out += "\x1b(";
+        out.push_back("0AB<>"[pick(5)]);
+        break;
+      default:
+        for (size_t n = pick(40); n > 0; --n) {
+          out.push_back(char(0x20 + pick(0x5f)));
+        }
+        break;
+    }
+  }
+  return out;
+}
+
+namespace {
+
+// Logs text and DCS data a code point or byte at a time, whichever calls
+// they arrive in, and collects the replies apart: they are buffered until
+// the end of each input call, so their place among the other calls depends
+// on the chunking.
+class SplitScreen : public vtutils::screen::DebugScreen {
+public:
+  SplitScreen(std::ostream &out, std::string &replies)
+    : DebugScreen(out), _replies(replies) { }
+
+  void print(char32_t sym, vtutils::screen::Attr *attr) override {
+    DebugScreen::print(sym, attr);
+  }
+  void print_run(
+      const char32_t *syms,
+      size_t num,
+      const vtutils::screen::Attr &attr) override {
+    for (size_t i = 0; i < num; ++i) {
+      vtutils::screen::Attr copy = attr;
+      print(syms[i], &copy);
+    }
+  }
+  void print_cluster(
+      const char32_t *syms,
+      size_t num,
+      const vtutils::screen::Attr &attr) override {
+    print_run(syms, num, attr);
+  }
+  void dcs_data(std::string_view data) override {
+    for (char c : data) {
+      DebugScreen::dcs_data(std::string_view(&c, 1));
+    }
+  }
+  void write(char c) override {
+    _replies.push_back(c);
+  }
+  void write(const char *data, size_t len) override {
+    _replies.append(data, len);
+  }
+  void flush() override { }
+
+private:
+  std::string &_replies;
+};
+
+} // namespace
+
+// The screen calls for input, fed in chunks of chunk bytes
+static std::string run_split(const std::string &input, size_t chunk, std::string &replies) {
+  std::ostringstream out;
+  SplitScreen screen(out, replies);
+  BasicVte<SplitScreen> vte(screen);
+  for (size_t pos = 0; pos < input.size(); pos += chunk) {
+    vte.input(input.data() + pos, std::min(chunk, input.size() - pos));
+  }
+  return out.str();
+}
+
+static void check_corpus() {
+  std::mt19937 rng(12345);
+  for (unsigned int run = 0; run < 40; ++run) {
+    std::string input = make_corpus(rng, 20000);
+    std::vector<size_t> chunks;
+    for (unsigned int i = 0; i < 16; ++i) {
+      chunks.push_back(1 + rng() % 300);
+    }
+    std::string got = run_parser(input, chunks);
+    std::string expected = run_reference_parser(input, chunks);
+    check(!expected.empty(), "corpus produced screen calls", 0, run);
+    if (got != expected) {
+      size_t i = 0;
+      while (i < got.size() && i < expected.size() && got[i] == expected[i]) {
+        ++i;
+      }
+      std::printf("FAIL: corpus run %u differs at byte %zu:\n", run, i);
+      std::printf("  table:     %s\n", got.substr(i, 80).c_str());
+      std::printf("  reference: %s\n", expected.substr(i, 80).c_str());
+      ++failures;
+    }
+
+    // the fast paths against one byte at a time
+    std::string replies_bytes;
+    std::string replies_chunks;
+    std::string bytes = run_split(input, 1, replies_bytes);
+    std::string chunked = run_split(input, 8192, replies_chunks);
+    check(bytes == chunked, "chunked input differs from one byte at a time", 0, run);
+    check(replies_bytes == replies_chunks, "chunked replies differ", 0, run);
+  }
+}
+
+int main() {
+  check_table();
+  check_corpus();
+  if (failures) {
+    std::printf("%d failures\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,137 @@
+// Checks the timing of RenderScheduler on a made up clock, which a fake Vte
+// advances as it parses: the time slices of feed, the poll timeouts, and
+// when frames are rendered.
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "render_scheduler.h"
+
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+using namespace vtutils::vte;
+
+struct FakeClock {
+  typedef std::chrono::nanoseconds duration;
+  typedef duration::rep rep;
+  typedef duration::period period;
+  typedef std::chrono::time_point<FakeClock> time_point;
+  static constexpr bool is_steady = true;
+
+  static time_point now() {
+    return current;
+  }
+  static time_point current;
+};
+FakeClock::time_point FakeClock::current;
+
+// Takes parse_cost of clock time for every CHUNK_SIZE bytes
+struct FakeVte {
+  size_t parsed = 0;
+  FakeClock::duration parse_cost{0};
+
+  void input(const char *data, size_t len) {
+    parsed += len;
+    FakeClock::current += parse_cost * len / RenderScheduler<FakeVte, FakeClock>::CHUNK_SIZE;
+  }
+};
+
+typedef RenderScheduler<FakeVte, FakeClock> Scheduler;
+static const size_t CHUNK_SIZE = Scheduler::CHUNK_SIZE;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+  if (!ok) {
+    std::printf("FAIL: %s\n", what);
+    ++failures;
+  }
+}
+
+// feed returns once the slice is used up, leaving the rest of its input
+static void check_slice() {
+  FakeClock::current = FakeClock::time_point(seconds(1));
+  FakeVte vte;
+  vte.parse_cost = milliseconds(1);
+  int renders = 0;
+  Scheduler scheduler(vte, [&] { ++renders; });
+  scheduler.set_slice(milliseconds(5));
+
+  std::string data(100 * CHUNK_SIZE, 'x');
+  size_t done = scheduler.feed(data.data(), data.size());
+  check(done == 5 * CHUNK_SIZE, "feed stops after the slice");
+  check(vte.parsed == done, "feed parses what it consumes");
+  check(scheduler.pending(), "changes pending after feed");
+
+  // input that fits the slice is consumed whole
+  vte.parse_cost = microseconds(10);
+  done = scheduler.feed(data.data(), 3 * CHUNK_SIZE);
+  check(done == 3 * CHUNK_SIZE, "feed consumes input within the slice");
+}
+
+// A lone change is drawn after the idle timeout, and poll says when
+static void check_idle() {
+  FakeClock::current = FakeClock::time_point(seconds(1));
+  FakeVte vte;
+  int renders = 0;
+  Scheduler scheduler(vte, [&] { ++renders; });
+  scheduler.set_frame_interval(milliseconds(16));
+  scheduler.set_idle_timeout(milliseconds(4));
+
+  check(scheduler.poll() == FakeClock::duration::max(), "nothing to draw");
+  scheduler.feed("a", 1);
+  check(renders == 0, "not drawn before the idle timeout");
+  check(scheduler.poll() == milliseconds(4), "poll waits for the idle timeout");
+  FakeClock::current += milliseconds(3);
+  check(scheduler.poll() == milliseconds(1), "poll counts down");
+  check(renders == 0, "not drawn while counting down");
+  FakeClock::current += milliseconds(1);
+  check(scheduler.poll() == FakeClock::duration::max(), "nothing left after drawing");
+  check(renders == 1 && !scheduler.pending(), "drawn once idle");
+
+  // the next change waits for the frame interval since that frame
+  FakeClock::current += milliseconds(2);
+  scheduler.feed("b", 1);
+  check(scheduler.poll() == milliseconds(14), "poll waits for the frame interval");
+  FakeClock::current += milliseconds(14);
+  scheduler.poll();
+  check(renders == 2, "drawn at the frame interval");
+}
+
+// Steady output, never idle, is drawn once per frame interval, by feed
+static void check_frame_rate() {
+  FakeClock::current = FakeClock::time_point(seconds(1));
+  FakeVte vte;
+  std::vector<FakeClock::time_point> renders;
+  Scheduler scheduler(vte, [&] { renders.push_back(FakeClock::now()); });
+  scheduler.set_frame_interval(milliseconds(16));
+  scheduler.set_idle_timeout(milliseconds(4));
+
+  for (int i = 0; i < 100; ++i) {
+    scheduler.feed("c", 1);
+    FakeClock::duration timeout = scheduler.poll();
+    // poll returns max() if it just rendered
+    check(scheduler.pending() ? timeout <= milliseconds(16) : timeout == FakeClock::duration::max(),
+        "poll timeout within a frame");
+    FakeClock::current += milliseconds(2);
+  }
+  // 200 ms of output
+  check(renders.size() >= 11 && renders.size() <= 13, "one frame per interval");
+  for (size_t i = 1; i < renders.size(); ++i) {
+    check(renders[i] - renders[i - 1] >= milliseconds(16), "frames a whole interval apart");
+  }
+}
+
+int main() {
+  check_slice();
+  check_idle();
+  check_frame_rate();
+  if (failures) {
+    std::printf("%d failures\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,70 @@
+// Checks the scroll regions set by DECSTBM on a GridScreen, including those
+// with omitted or invalid margins.
+
+#include <cstdio>
+#include <string>
+
+#include "grid_screen.h"
+#include "vte_impl.h"
+
+using namespace vtutils;
+
+static const unsigned int ROWS = 6;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what, const std::string &input) {
+  if (!ok) {
+    std::printf("FAIL: %s, after \"\\e%s\"\n", what, input.substr(1).c_str());
+    ++failures;
+  }
+}
+
+// Sets a region with input, then finds its margins by moving the cursor
+// as far up and down as it goes from inside it, and checks that a line
+// feed at the bottom margin scrolls the region only
+static void check_region(const std::string &input, unsigned int top, unsigned int bottom) {
+  screen::GridScreen screen(10, ROWS);
+  vte::BasicVte<screen::GridScreen> vte(screen);
+  for (unsigned int y = 0; y < ROWS; ++y) {
+    vte.input("\x1b[" + std::to_string(y + 1) + "H" + std::to_string(y));
+  }
+  vte.input(input);
+  check(screen.cursor_x() == 0 && screen.cursor_y() == 0, "cursor homed", input);
+
+  vte.input("\x1b[" + std::to_string(top + 1) + "H\x1b[99A");
+  check(screen.cursor_y() == top, "top margin", input);
+  vte.input("\x1b[99B");
+  check(screen.cursor_y() == bottom, "bottom margin", input);
+
+  vte.input("\n");
+  for (unsigned int y = 0; y < ROWS; ++y) {
+    std::string expected;
+    if (y < top || y > bottom) {
+      expected = std::to_string(y);
+    } else if (y < bottom) {
+      expected = std::to_string(y + 1);
+    }
+    check(screen.line(y) == expected, "rows scrolled", input);
+  }
+}
+
+int main() {
+  check_region("\x1b[2;4r", 1, 3);
+  check_region("\x1b[r", 0, ROWS - 1);
+  check_region("\x1b[0;0r", 0, ROWS - 1);
+  // an omitted bottom margin is the last row, whatever the top one
+  check_region("\x1b[5r", 4, ROWS - 1);
+  check_region("\x1b[3;0r", 2, ROWS - 1);
+  check_region("\x1b[;3r", 0, 2);
+  // invalid regions select the whole screen
+  check_region("\x1b[4;2r", 0, ROWS - 1);
+  check_region("\x1b[3;3r", 0, ROWS - 1);
+  check_region("\x1b[2;99r", 0, ROWS - 1);
+  check_region("\x1b[6r", 0, ROWS - 1);
+  if (failures) {
+    std::printf("%d failures\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,211 @@
+// Checks that Scrollback gives back the lines pushed into it, from the hot
+// blocks and from the compressed cold ones, that it keeps to its byte
+// budget by dropping the oldest blocks, and that search finds the lines
+// reading them would.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "grid_screen.h"
+#include "scrollback.h"
+
+using namespace vtutils::screen;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what, size_t n) {
+  if (!ok) {
+    if (failures < 20) {
+      std::printf("FAIL: %s, line %zu\n", what, n);
+    }
+    ++failures;
+  }
+}
+
+// Pushes the ASCII text as one row, all cells with attribute id
+static void push(
+    Scrollback &scrollback,
+    const std::string &text,
+    attr_id id,
+    const AttrTable &table,
+    const ClusterTable &clusters,
+    bool wrapped = false) {
+  std::vector<char32_t> chars(text.begin(), text.end());
+  std::vector<attr_id> attrs(text.size(), id);
+  scrollback.push(chars.data(), attrs.data(), chars.size(), table, clusters, wrapped);
+}
+
+static std::string line_text(size_t i) {
+  return "line " + std::to_string(i) + " of the history";
+}
+
+// Lines read back from hot and cold blocks, in any order
+static void check_lines() {
+  AttrTable table;
+  ClusterTable clusters;
+  Attr bold{};
+  bold.bold = true;
+  attr_id bold_id = table.intern(bold);
+
+  Scrollback scrollback(SIZE_MAX);
+  const size_t num = (Scrollback::HOT_BLOCKS + 3) * Scrollback::BLOCK_LINES + 17;
+  for (size_t i = 0; i < num; ++i) {
+    push(scrollback, line_text(i), i % 3 ? DEFAULT_ATTR_ID : bold_id, table, clusters);
+  }
+  check(scrollback.size() == num, "size", num);
+
+  // oldest first, then newest first, so cold blocks are decompressed on
+  // each read across their boundaries
+  ScrollbackLine line;
+  for (size_t pass = 0; pass < 2; ++pass) {
+    for (size_t k = 0; k < num; ++k) {
+      size_t n = pass ? k : num - 1 - k;
+      size_t i = num - 1 - n;
+      std::string expected = line_text(i);
+      check(scrollback.text(n) == expected, "text", n);
+      check(scrollback.get(n, line), "get", n);
+      check(std::u32string(line.chars.begin(), line.chars.end())
+          == std::u32string(expected.begin(), expected.end()), "chars", n);
+      check(line.attrs.size() == expected.size()
+          && line.attrs[0].bold == (i % 3 == 0), "attributes", n);
+      check(!line.wrapped, "not wrapped", n);
+    }
+  }
+  check(!scrollback.get(num, line), "get out of range", num);
+  check(scrollback.text(num).empty(), "text out of range", num);
+
+  // a wrapped row is joined to the next one, and reads as line 0 until
+  // that one is pushed
+  push(scrollback, "first half, ", DEFAULT_ATTR_ID, table, clusters, true);
+  check(scrollback.size() == num + 1 && scrollback.text(0) == "first half, ",
+      "joining line", 0);
+  push(scrollback, "second half", DEFAULT_ATTR_ID, table, clusters);
+  check(scrollback.size() == num + 1, "joined size", 0);
+  check(scrollback.text(0) == "first half, second half", "joined line", 0);
+  check(scrollback.text(1) == line_text(num - 1), "line before the join", 1);
+}
+
+// The budget holds after every push, and the newest lines survive
+static void check_budget() {
+  AttrTable table;
+  ClusterTable clusters;
+  const size_t budget = 64 * 1024;
+  Scrollback scrollback(budget);
+  size_t num = 20 * Scrollback::BLOCK_LINES;
+  size_t max_size = 0;
+  for (size_t i = 0; i < num; ++i) {
+    push(scrollback, line_text(i) + std::string(i % 50, '.'), DEFAULT_ATTR_ID, table, clusters);
+    check(scrollback.bytes() <= budget, "bytes over budget", i);
+    max_size = std::max(max_size, scrollback.size());
+  }
+  check(scrollback.size() < num, "old lines dropped", scrollback.size());
+  check(scrollback.size() % Scrollback::BLOCK_LINES == 0, "whole blocks dropped", scrollback.size());
+  for (size_t n = 0; n < scrollback.size(); n += 97) {
+    size_t i = num - 1 - n;
+    check(scrollback.text(n) == line_text(i) + std::string(i % 50, '.'), "kept line", n);
+  }
+
+  scrollback.set_byte_budget(budget / 2);
+  check(scrollback.bytes() <= budget / 2, "bytes over a lowered budget", 0);
+  check(scrollback.size() < max_size, "lowered budget drops lines", scrollback.size());
+  check(scrollback.text(0) == line_text(num - 1) + std::string((num - 1) % 50, '.'),
+      "newest line kept", 0);
+}
+
+// The lines containing query, newest first, by reading each one
+static std::vector<size_t> search_by_text(
+    Scrollback &scrollback,
+    std::string query,
+    bool ignore_case) {
+  auto fold = [](std::string text) {
+    for (char &c : text) {
+      c = std::tolower((unsigned char) c);
+    }
+    return text;
+  };
+  if (ignore_case) {
+    query = fold(query);
+  }
+  std::vector<size_t> results;
+  for (size_t n = 0; n < scrollback.size(); ++n) {
+    std::string text = scrollback.text(n);
+    if ((ignore_case ? fold(text) : text).find(query) != std::string::npos) {
+      results.push_back(n);
+    }
+  }
+  return results;
+}
+
+static void check_search() {
+  AttrTable table;
+  ClusterTable clusters;
+  Scrollback scrollback(SIZE_MAX);
+  // varied enough that the filters of the cold blocks tell them apart
+  const size_t num = (Scrollback::HOT_BLOCKS + 4) * Scrollback::BLOCK_LINES;
+  for (size_t i = 0; i < num; ++i) {
+    std::string text = "Request " + std::to_string(i * 7919 % 100003)
+        + (i % 5 ? " served" : " FAILED") + " on worker-" + std::to_string(i % 13);
+    push(scrollback, text, DEFAULT_ATTR_ID, table, clusters);
+  }
+
+  std::vector<size_t> results;
+  for (const char *query : {
+      "FAILED", "failed", "Request 7919 ", "worker-12", "quest 1", "on w",
+      "ed", "", "no such text", "REQUEST 15838 SERVED"}) {
+    for (bool ignore_case : {false, true}) {
+      results.clear();
+      size_t found = scrollback.search(query, ignore_case, results);
+      check(found == results.size(), "search count", found);
+      check(results == search_by_text(scrollback, query, ignore_case),
+          ignore_case ? "case-insensitive search" : "literal search", results.size());
+    }
+  }
+
+  // numbered the same in hot and cold blocks: the oldest line is cold
+  results.clear();
+  scrollback.search("Request 0 served", false, results);
+  check(results.empty(), "oldest line not served", 0);
+  results.clear();
+  scrollback.search("Request 0 FAILED", false, results);
+  check(results == std::vector<size_t>{num - 1}, "oldest line numbered", num - 1);
+  results.clear();
+  scrollback.search("Request " + std::to_string((num - 1) * 7919 % 100003) + " ", false, results);
+  check(results == std::vector<size_t>{0}, "newest line numbered", 0);
+  results.clear();
+  scrollback.search("FAILED", false, results, 3);
+  check(results == std::vector<size_t>{(num - 1) % 5, (num - 1) % 5 + 5, (num - 1) % 5 + 10},
+      "limited search", results.size());
+
+  // a query over the join of a wrapped line, before and after its last row
+  // is pushed
+  push(scrollback, "the wrapped li", DEFAULT_ATTR_ID, table, clusters, true);
+  results.clear();
+  scrollback.search("WRAPPED LI", true, results);
+  check(results == std::vector<size_t>{0}, "search in the joining line", 0);
+  push(scrollback, "ne goes on here", DEFAULT_ATTR_ID, table, clusters);
+  results.clear();
+  scrollback.search("wrapped line goes", false, results);
+  check(results == std::vector<size_t>{0}, "search over a join", 0);
+  const size_t filler = Scrollback::HOT_BLOCKS * Scrollback::BLOCK_LINES;
+  for (size_t i = 0; i < filler; ++i) {
+    push(scrollback, "filler " + std::to_string(i), DEFAULT_ATTR_ID, table, clusters);
+  }
+  results.clear();
+  scrollback.search("Wrapped Line Goes", true, results);
+  check(results == std::vector<size_t>{filler},
+      "search over a join in a cold block", results.size());
+}
+
+int main() {
+  check_lines();
+  check_budget();
+  check_search();
+  if (failures) {
+    std::printf("%d failures\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,136 @@
+// Checks read_snapshot from another thread while the GridScreen is written
+// to: each snapshot must hold the rows of a single publish, never a row
+// half overwritten by the next, and the size and cursor that go with them,
+// even while the screen is resized under the reader.
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "grid_screen.h"
+#include "vte_impl.h"
+
+using namespace vtutils;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what, const screen::GridSnapshot &snapshot) {
+  if (!ok) {
+    std::printf("FAIL: %s, %ux%u generation %llu\n", what, snapshot.cols,
+                snapshot.rows, (unsigned long long)snapshot.generation);
+    ++failures;
+  }
+}
+
+static const unsigned int SIZES[][2] = {
+  {80, 24}, {20, 5}, {133, 50}, {7, 3}, {200, 60}, {80, 1},
+};
+static const unsigned int NUM_SIZES = sizeof(SIZES) / sizeof(SIZES[0]);
+
+static bool known_size(unsigned int cols, unsigned int rows) {
+  for (unsigned int i = 0; i < NUM_SIZES; ++i) {
+    if (SIZES[i][0] == cols && SIZES[i][1] == rows) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Resizes the screen through SIZES, filling it with a letter after each
+// resize, while a reader thread takes snapshots
+static void check_resize() {
+  screen::GridScreen screen(SIZES[0][0], SIZES[0][1]);
+  vte::BasicVte<screen::GridScreen> vte(screen);
+  screen.enable_snapshots();
+
+  std::atomic<bool> done{false};
+  unsigned long snapshots = 0;
+  std::thread reader([&] {
+    screen::GridSnapshot snapshot;
+    while (!done.load(std::memory_order_relaxed)) {
+      check(screen.read_snapshot(snapshot), "read_snapshot", snapshot);
+      check(known_size(snapshot.cols, snapshot.rows), "size", snapshot);
+      check(snapshot.chars.size() == size_t(snapshot.cols) * snapshot.rows &&
+            snapshot.attrs.size() == snapshot.chars.size(), "cell count", snapshot);
+      check(snapshot.cursor_x < snapshot.cols && snapshot.cursor_y < snapshot.rows,
+            "cursor", snapshot);
+      for (char32_t c : snapshot.chars) {
+        if (c != 0 && c != ' ' && (c < 'a' || c > 'z')) {
+          check(false, "cell", snapshot);
+          break;
+        }
+      }
+      ++snapshots;
+    }
+  });
+
+  for (unsigned int i = 0; i < 3000; ++i) {
+    unsigned int cols = SIZES[i % NUM_SIZES][0];
+    unsigned int rows = SIZES[i % NUM_SIZES][1];
+    screen.resize(cols, rows);
+    vte.input("\x1b[H" + std::string(cols * rows, char('a' + i % 26)));
+  }
+  done = true;
+  reader.join();
+
+  screen::GridSnapshot snapshot;
+  screen.read_snapshot(snapshot);
+  check(snapshot.cols == SIZES[2999 % NUM_SIZES][0] &&
+        snapshot.rows == SIZES[2999 % NUM_SIZES][1], "final size", snapshot);
+  check(snapshots > 0, "no snapshots taken", snapshot);
+}
+
+// Prints screens whose rows are each filled with one letter, the letter of
+// row y being that of row 0 plus y, while a reader thread checks that every
+// snapshot holds such a screen
+static void check_torn_rows() {
+  const unsigned int cols = 100, rows = 30;
+  screen::GridScreen screen(cols, rows);
+  vte::BasicVte<screen::GridScreen> vte(screen);
+  std::string input = "\x1b[H" + std::string(cols * rows, ' ');
+  auto fill = [&](unsigned int i) {
+    for (unsigned int y = 0; y < rows; ++y) {
+      input.replace(3 + y * cols, cols, cols, char('a' + (i + y) % 26));
+    }
+    vte.input(input);
+  };
+  fill(0);
+  screen.enable_snapshots();
+
+  std::atomic<bool> done{false};
+  unsigned long snapshots = 0;
+  std::thread reader([&] {
+    screen::GridSnapshot snapshot;
+    while (!done.load(std::memory_order_relaxed)) {
+      screen.read_snapshot(snapshot);
+      char32_t first = snapshot.chars[0];
+      for (unsigned int y = 0; y < rows; ++y) {
+        char32_t letter = 'a' + (first - 'a' + y) % 26;
+        bool uniform = true;
+        for (unsigned int x = 0; x < cols; ++x) {
+          uniform = uniform && snapshot.chars[y * cols + x] == letter;
+        }
+        check(uniform, "torn row", snapshot);
+      }
+      ++snapshots;
+    }
+  });
+
+  for (unsigned int i = 1; i < 5000; ++i) {
+    fill(i);
+  }
+  done = true;
+  reader.join();
+
+  screen::GridSnapshot snapshot;
+  check(snapshots > 0, "no snapshots taken", snapshot);
+}
+
+int main() {
+  check_torn_rows();
+  check_resize();
+
+  std::printf("%d failures\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+// Checks that Utf8To32Converter::decode gives the same code points as put,
+// one char at a time, with the input split into blocks at random: valid
+// sequences, and invalid, overlong, surrogate and truncated ones. Built
+// twice, the second time with the SIMD paths of unicode.cc left out.
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "unicode.h"
+
+using namespace vtutils::unicode;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what, unsigned int run) {
+  if (!ok) {
+    std::printf("FAIL: %s, run %u\n", what, run);
+    ++failures;
+  }
+}
+
+static std::string make_corpus(std::mt19937 &rng, size_t size) {
+  auto pick = [&](size_t n) { return size_t(rng() % n); };
+  static const char *const pieces[] = {
+    "\xc3\xa9", "\xe4\xb8\xad", "\xf0\x9f\x91\x8d", "\xf4\x8f\xbf\xbf",
+    // overlong
+    "\xc0\xaf", "\xc1\xbf", "\xe0\x80\xaf", "\xf0\x80\x80\xaf",
+    // surrogates
+    "\xed\xa0\x80", "\xed\xbf\xbf",
+    // truncated
+    "\xc3", "\xe4\xb8", "\xf0\x9f\x91",
+    // out of range lead bytes and stray continuations
+    "\xf5\x80\x80\x80", "\xf8", "\xff", "\x80", "\xbf\xbf",
+  };
+
+  std::string out;
+  while (out.size() < size) {
+    switch (pick(4)) {
+      case 0:
+        // long enough for the SIMD blocks
+        for (size_t n = pick(100); n > 0; --n) {
+          out.push_back(char(pick(0x80)));
+        }
+        break;
+      case 1:
+        out.push_back(char(pick(0x100)));
+        break;
+      default:
+        out += pieces[pick(sizeof(pieces) / sizeof(*pieces))];
+        break;
+    }
+  }
+  return out;
+}
+
+static std::vector<char32_t> decode_by_put(const std::string &input) {
+  Utf8To32Converter converter;
+  std::vector<char32_t> out;
+  char32_t code_point;
+  for (char c : input) {
+    if (converter.put(c, code_point)) {
+      out.push_back(code_point);
+    }
+  }
+  return out;
+}
+
+// Decodes input in blocks, of size chunk or of random sizes if chunk is 0
+static std::vector<char32_t> decode_in_blocks(
+    const std::string &input,
+    size_t chunk,
+    std::mt19937 &rng) {
+  Utf8To32Converter converter;
+  std::vector<char32_t> out(input.size());
+  size_t num = 0;
+  for (size_t pos = 0; pos < input.size();) {
+    size_t len = chunk ? chunk : 1 + rng() % 70;
+    len = std::min(len, input.size() - pos);
+    num += converter.decode(input.data() + pos, len, out.data() + num);
+    pos += len;
+  }
+  out.resize(num);
+  return out;
+}
+
+int main() {
+  std::mt19937 rng(4242);
+  for (unsigned int run = 0; run < 300; ++run) {
+    std::string input = make_corpus(rng, 1 + rng() % 5000);
+    std::vector<char32_t> expected = decode_by_put(input);
+    check(decode_in_blocks(input, 1, rng) == expected, "one char blocks", run);
+    check(decode_in_blocks(input, 4096, rng) == expected, "4096 char blocks", run);
+    check(decode_in_blocks(input, 0, rng) == expected, "random blocks", run);
+  }
+
+  // replacement characters, and a sequence resumed in the next block
+  Utf8To32Converter converter;
+  char32_t out[8];
+  check(converter.decode("\xc0\xaf", 2, out) == 1 && out[0] == 0xfffd, "overlong rejected", 0);
+  check(converter.decode("a\xf0\x9f", 3, out) == 1 && !converter.idle(), "sequence left open", 0);
+  check(converter.decode("\x91\x8d", 2, out) == 1 && out[0] == 0x1f44d, "sequence resumed", 0);
+  check(converter.decode("\xe4" "a", 2, out) == 1 && out[0] == 0xfffd, "truncated sequence", 0);
+
+  if (failures) {
+    std::printf("%d failures\n", failures);
+    return 1;
+  }
+  return 0;
+}